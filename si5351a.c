@@ -3,15 +3,7 @@
 // Date: Fri Sep 14 21:35:21 2018   (C) ve3wwg@gmail.com
 ///////////////////////////////////////////////////////////////////////
 
-#include <stdio.h>
-#include <stdarg.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <errno.h>
 #include <string.h>
-#include <assert.h>
-
-#include <memory.h>
 
 #include "si5351a.h"
 
@@ -21,19 +13,11 @@
 #define SI5351_PLL_A_MAX                90
 #define SI5351_PLL_B_MAX                (SI5351_PLL_C_MAX-1)
 #define SI5351_PLL_C_MAX                1048575
+#define SI5351_MS_A_MIN                 8
+#define SI5351_MS_A_MAX                 2048
 
 #define Offset(member) (uint16_t)(((uint8_t*)&(((Si5351A*)0)->member)) - ((uint8_t*)0))
 
-typedef union {
-	struct {
-		uint32_t	bits_7_0 : 8;
-		uint32_t	bits_15_8 : 8;
-		uint32_t	bits_19_16 : 4;
-		uint32_t	unused : 12;
-	} 		parts;
-	uint32_t	u;
-} u_value;
-
 static const struct s_reg {
 	uint8_t		reg;
 	uint16_t	offset;
@@ -88,6 +72,7 @@ static const struct s_reg {
 	{ 63,	Offset(m[2].r47) },	
 	{ 64,	Offset(m[2].r48) },	
 	{ 65,	Offset(m[2].r49) },	
+#ifndef SI5351A_NO_SPREAD
 	{ 149,	Offset(r149) },	
 	{ 150,	Offset(r150) },	
 	{ 151,	Offset(r151) },	
@@ -101,30 +86,145 @@ static const struct s_reg {
 	{ 159,	Offset(r159) },	
 	{ 160,	Offset(r160) },	
 	{ 161,	Offset(r161) },	
+#endif
+#ifndef SI5351A_NO_PHASE
 	{ 165,	Offset(r165) },	
 	{ 166,	Offset(r166) },	
 	{ 167,	Offset(r167) },	
+#endif
 	{ 177,	Offset(r177) },	
 	{ 183,	Offset(r183) },	
 	{ 255, 0 }
 };
 
 static int
-readbuf(Si5351A *si,uint8_t reg,uint8_t *buf,uint8_t buflen) {
-	int n;
+reg_offset(uint8_t reg) {
 
-	if ( (n = si->i2c_write(si->i2c_addr,&reg,1)) != buflen )
-		return -1;
-	return si->i2c_read(si->i2c_addr,buf,buflen);
+	for ( unsigned x=0; regs[x].reg != 255; ++x )
+		if ( regs[x].reg == reg )
+			return regs[x].offset;
+	return -1;
+}
+
+//////////////////////////////////////////////////////////////////////
+// I/O layer with retry policy
+//
+// The i2c callbacks return a negative value on failure, optionally
+// one of SI5351A_ENAK, SI5351A_EARB or SI5351A_ETIMEOUT to select the
+// retry class. A failed transfer is retried per si->retry; a write
+// that still fails marks its registers as not known-good.
+//////////////////////////////////////////////////////////////////////
+
+static ErrClass
+err_class(int rc) {
+
+	switch ( rc ) {
+	case SI5351A_ENAK:
+		return ErrNak;
+	case SI5351A_EARB:
+		return ErrArb;
+	case SI5351A_ETIMEOUT:
+		return ErrTimeout;
+	default:
+		return rc < 0 ? ErrIO : ErrNone;
+	}
+}
+
+static const RetryPolicy retry_dflt = {
+	.attempts = {
+		[ErrNone] = 1,
+		[ErrIO] = 1,
+		[ErrNak] = 3,		// Device busy or glitch
+		[ErrArb] = 3,		// Lost arbitration: bus shared
+		[ErrTimeout] = 2
+	},
+	.backoff_us = 100,
+	.backoff_max_us = 10000
+};
+
+static bool
+retry(Si5351A *si,int rc,unsigned attempt) {
+#ifndef SI5351A_MINIMAL
+	const RetryPolicy *rp = &si->retry;
+#else
+	const RetryPolicy *rp = si->retry ? si->retry : &retry_dflt;
+#endif
+	uint32_t us;
+
+	if ( attempt >= rp->attempts[err_class(rc)] )
+		return false;
+	if ( rp->delay ) {
+		us = rp->backoff_us;
+		for ( unsigned x=1; x < attempt && us < rp->backoff_max_us; ++x )
+			us <<= 1;
+		rp->delay(si->arg,us < rp->backoff_max_us ? us : rp->backoff_max_us);
+	}
+	return true;
+}
+
+static void
+io_status(Si5351A *si,int rc,uint8_t reg,uint8_t len,unsigned attempts,bool wr) {
+
+	si->status.err = err_class(rc);
+	si->status.reg = reg;
+	si->status.len = len;
+	si->status.attempts = attempts;
+
+#ifndef SI5351A_MINIMAL
+	if ( !wr )
+		return;
+	for ( unsigned r=reg; r < (unsigned)reg + len && r < 256; ++r ) {
+		if ( rc < 0 )
+			si->unknown[r >> 3] |= 1 << (r & 7);
+		else	si->unknown[r >> 3] &= ~(1 << (r & 7));
+	}
+#else
+	(void)wr;
+#endif
+}
+
+static int
+readbuf(Si5351A *si,uint8_t reg,uint8_t *buf,uint8_t buflen) {
+	unsigned attempt;
+	int rc;
+
+	for ( attempt=1; ; ++attempt ) {
+#ifndef SI5351A_MINIMAL
+		si->txns += 2;
+		si->bytes += 1 + buflen;
+#endif
+		if ( (rc = si->i2c_write(si->i2c_addr,&reg,1)) >= 0
+		  && (rc = si->i2c_read(si->i2c_addr,buf,buflen)) >= 0 )
+			break;
+		if ( !retry(si,rc,attempt) )
+			break;
+	}
+	io_status(si,rc,reg,buflen,attempt,false);
+	return rc;
 }
 
 static int
-writebuf(Si5351A *si,uint8_t reg,uint8_t *buf,uint8_t buflen) {
-	uint8_t iobuf[1+buflen];
+writebuf(Si5351A *si,uint8_t reg,const uint8_t *buf,uint8_t buflen) {
+	uint8_t iobuf[1+SI5351A_BURST_MAX];
+	unsigned attempt;
+	int rc;
 
+	if ( buflen > SI5351A_BURST_MAX )
+		return -1;
 	iobuf[0] = reg;
 	memcpy(iobuf+1,buf,buflen);
-	return si->i2c_write(si->i2c_addr,iobuf,1+buflen);
+	for ( attempt=1; ; ++attempt ) {
+#ifndef SI5351A_MINIMAL
+		++si->txns;
+		si->bytes += 1 + buflen;
+#endif
+		if ( (rc = si->i2c_write(si->i2c_addr,iobuf,1+buflen)) >= 0 )
+			break;
+		if ( !retry(si,rc,attempt) )
+			break;
+	}
+	io_status(si,rc,reg,buflen,attempt,true);
+	return rc;
 }
 
 static int
@@ -137,32 +237,129 @@ read1(Si5351A *si,uint8_t reg,void *dat) {
 	return readbuf(si,reg,(uint8_t*)dat,1);
 }
 
+#ifndef SI5351A_NO_SPREAD
+static bool spread_follow(Si5351A *si,uint8_t reg,unsigned len);
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Set up the device structure without bus access (follow with
+// Si5351A_device_reset() or Si5351A_reset_begin()).
+//////////////////////////////////////////////////////////////////////
+
 void
-Si5351A_init(Si5351A *si,uint8_t i2c_addr,i2c_readcb_t readcb,i2c_writecb_t writecb,void *arg,XtalCap cap) {
+Si5351A_attach(Si5351A *si,uint8_t i2c_addr,i2c_readcb_t readcb,i2c_writecb_t writecb,void *arg) {
 
 	memset(si,0,sizeof *si);
 	si->i2c_addr = i2c_addr;
 	si->i2c_read = readcb;
 	si->i2c_write = writecb;
 	si->arg = arg;
-	Si5351A_device_reset(si,cap);
+	si->xtal_hz = SI5351A_XTAL_HZ;
+#ifndef SI5351A_MINIMAL
+	Si5351A_bus_cost(&si->bus,100000);
+	Si5351A_retry_default(&si->retry);
+#endif
+}
+
+bool
+Si5351A_init(Si5351A *si,uint8_t i2c_addr,i2c_readcb_t readcb,i2c_writecb_t writecb,void *arg,XtalCap cap) {
+
+	Si5351A_attach(si,i2c_addr,readcb,writecb,arg);
+	return Si5351A_device_reset(si,cap);
+}
+
+void
+Si5351A_retry_default(RetryPolicy *rp) {
+
+	*rp = retry_dflt;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Set the retry policy. The SI5351A_MINIMAL build keeps the pointer,
+// so rp must stay valid (null selects the default).
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_retry_policy(Si5351A *si,const RetryPolicy *rp) {
+
+#ifndef SI5351A_MINIMAL
+	si->retry = *rp;
+#else
+	si->retry = rp;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Outcome of the most recent transfer (after retries).
+//////////////////////////////////////////////////////////////////////
+
+const IoStatus *
+Si5351A_status(const Si5351A *si) {
+
+	return &si->status;
+}
+
+//////////////////////////////////////////////////////////////////////
+// False when the last write covering reg failed, so the device may
+// not match the shadow for that register.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef SI5351A_MINIMAL
+bool
+Si5351A_reg_known_good(const Si5351A *si,uint8_t reg) {
+
+	return !(si->unknown[reg >> 3] & (1 << (reg & 7)));
 }
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Busy (in system init). A failed read reports not busy; check
+// Si5351A_status() to tell the two apart.
+//////////////////////////////////////////////////////////////////////
 
 bool
 Si5351A_is_busy(Si5351A *si) {
 
-	read1(si,0,&si->r0);
+	if ( read1(si,0,&si->r0) < 0 )
+		return false;
 	return si->r0.sys_init;
 }
 
-static void
+//////////////////////////////////////////////////////////////////////
+// Read every shadowed register, one burst per run of consecutive
+// register numbers.
+//////////////////////////////////////////////////////////////////////
+
+static bool
 read_all(Si5351A *si) {
+	uint8_t buf[SI5351A_BURST_MAX];
+
+	for ( unsigned x=0, n; regs[x].reg != 255; x += n ) {
+		for ( n=1; n < sizeof buf && regs[x+n].reg == regs[x].reg + n; ++n )
+			;
+		if ( readbuf(si,regs[x].reg,buf,n) < 0 )
+			return false;
+		for ( unsigned y=0; y<n; ++y )
+			((uint8_t *)si)[regs[x+y].offset] = buf[y];
+	}
+	return true;
+}
 
-	for ( unsigned x=0; regs[x].reg != 255; ++x )
-		read1(si,regs[x].reg,(uint8_t*)si + regs[x].offset);
+static const struct s_r16 *
+clock_ctl(const Si5351A *si,int clockx) {
+
+	switch ( clockx ) {
+	case 0:
+		return &si->r16;
+	case 1:
+		return &si->r17;
+	default:
+		return &si->r18;
+	}
 }
 
-void
+
+bool
 Si5351A_clock_enable(Si5351A *si,int clockx,bool on) {
 
 	switch ( clockx ) {
@@ -175,11 +372,13 @@ Si5351A_clock_enable(Si5351A *si,int clockx,bool on) {
 	case 2:
 		si->r3.clk2_oeb = on ? 0 : 1;
 		break;
+	default:
+		return false;
 	}
-	write1(si,3,&si->r3);
+	return write1(si,3,&si->r3) >= 0;
 }
 
-void
+bool
 Si5351A_clock_enable_pin(Si5351A *si,int clockx,bool enable) {
 
 	switch ( clockx ) {
@@ -192,129 +391,125 @@ Si5351A_clock_enable_pin(Si5351A *si,int clockx,bool enable) {
 	case 2:
 		si->r9.oeb_clk2 = enable ? 0 : 1;
 		break;
+	default:
+		return false;
 	}
-	write1(si,9,&si->r9);
+	return write1(si,9,&si->r9) >= 0;
 }
 
-void
+bool
 Si5351A_clock_power(Si5351A *si,int clockx,bool on) {
 
 	switch ( clockx ) {
 	case 0:
 		si->r16.clkx_pdn = on ? 0 : 1;
-		write1(si,16,&si->r16);
-		break;
+		return write1(si,16,&si->r16) >= 0;
 	case 1:
 		si->r17.clkx_pdn = on ? 0 : 1;
-		write1(si,17,&si->r17);
-		break;
+		return write1(si,17,&si->r17) >= 0;
 	case 2:
 		si->r18.clkx_pdn = on ? 0 : 1;
-		write1(si,18,&si->r18);
-		break;
+		return write1(si,18,&si->r18) >= 0;
+	default:
+		return false;
 	}
 }
 
-void
+bool
 Si5351A_clock_msynth(Si5351A *si,int clockx,MultiSynthMode mode) {
 	bool mint = mode == IntegerMode ? true : false;
 
 	switch ( clockx ) {
 	case 0:
 		si->r16.msx_int = mint;
-		write1(si,16,&si->r16);
-		break;
+		return write1(si,16,&si->r16) >= 0;
 	case 1:
 		si->r17.msx_int = mint;
-		write1(si,17,&si->r17);
-		break;
+		return write1(si,17,&si->r17) >= 0;
 	case 2:
 		si->r18.msx_int = mint;
-		write1(si,18,&si->r18);
-		break;
+		return write1(si,18,&si->r18) >= 0;
+	default:
+		return false;
 	}
 }
 
-void
+bool
 Si5351A_clock_pll(Si5351A *si,int clockx,int pllx) {
 	bool pllb = pllx == 1;
 
 	switch ( clockx ) {
 	case 0:
 		si->r16.msx_src = pllb;
-		write1(si,16,&si->r16);
-		break;
+		return write1(si,16,&si->r16) >= 0;
 	case 1:
 		si->r17.msx_src = pllb;
-		write1(si,17,&si->r17);
-		break;
+		return write1(si,17,&si->r17) >= 0;
 	case 2:
 		si->r18.msx_src = pllb;
-		write1(si,18,&si->r18);
-		break;
+		return write1(si,18,&si->r18) >= 0;
+	default:
+		return false;
 	}
 }
 
-void
+bool
 Si5351A_clock_polarity(Si5351A *si,int clockx,bool invert) {
 
 	switch ( clockx ) {
 	case 0:
 		si->r16.clkx_inv = invert;
-		write1(si,16,&si->r16);
-		break;
+		return write1(si,16,&si->r16) >= 0;
 	case 1:
 		si->r17.clkx_inv = invert;
-		write1(si,17,&si->r17);
-		break;
+		return write1(si,17,&si->r17) >= 0;
 	case 2:
 		si->r18.clkx_inv = invert;
-		write1(si,18,&si->r18);
-		break;
+		return write1(si,18,&si->r18) >= 0;
+	default:
+		return false;
 	}
 }
 
-void
+bool
 Si5351A_clock_source(Si5351A *si,int clockx,ClockSource src) {
 	unsigned s = (unsigned)src;
 
 	switch ( clockx ) {
 	case 0:
 		si->r16.clkx_src = s;
-		write1(si,16,&si->r16);
-		break;
+		return write1(si,16,&si->r16) >= 0;
 	case 1:
 		si->r17.clkx_src = s;
-		write1(si,17,&si->r17);
-		break;
+		return write1(si,17,&si->r17) >= 0;
 	case 2:
 		si->r18.clkx_src = s;
-		write1(si,18,&si->r18);
-		break;
+		return write1(si,18,&si->r18) >= 0;
+	default:
+		return false;
 	}
 }
 
-void
+bool
 Si5351A_clock_drive(Si5351A *si,int clockx,ClockDrive drv) {
 	unsigned d = (unsigned)drv;
 
 	switch ( clockx ) {
 	case 0:
 		si->r16.clkx_idrv = d;
-		write1(si,16,&si->r16);
-		break;
+		return write1(si,16,&si->r16) >= 0;
 	case 1:
 		si->r17.clkx_idrv = d;
-		write1(si,17,&si->r17);
-		break;
+		return write1(si,17,&si->r17) >= 0;
 	case 2:
 		si->r18.clkx_idrv = d;
-		write1(si,18,&si->r18);
-		break;
+		return write1(si,18,&si->r18) >= 0;
+	default:
+		return false;
 	}
 }
 
-void
+bool
 Si5351A_clock_disable_state(Si5351A *si,int clockx,DisState state) {
 	unsigned s = (unsigned)state;
 
@@ -328,74 +523,19 @@ Si5351A_clock_disable_state(Si5351A *si,int clockx,DisState state) {
 	case 2:
 		si->r24.clk2_dis_state = s;
 		break;
+	default:
+		return false;
 	}
-	write1(si,24,&si->r24);
+	return write1(si,24,&si->r24) >= 0;
 }
 
 bool
 Si5351A_set_msynth(Si5351A *si,short msynthx,uint32_t A,uint32_t B,uint32_t C) {
-	u_value P1, P2, P3;
-
-	P2.u = (128u * B) % C;
-	P1.u = 128u * A;
-	P1.u += (128 * B / C);
-	P1.u -= 512;
-	P3.u = C;
-
-	//////////////////////////////////////////////////////////////
-	// Unfortunately, due to an ARM gcc bug, we cannot take an
-	// address of &si->m[msynthx] correctly. So use the switch
-	// statement below to generate correct code.
-	// gcc (Raspbian 6.3.0-18+rpi1+deb9u1) 6.3.0 20170516
-	//////////////////////////////////////////////////////////////
-
-	switch ( msynthx ) {
-	case 0:
-		si->m[0].r46.msx_p1_7_0 = P1.parts.bits_7_0;	// Integer
-		si->m[0].r45.msx_p1_15_8 = P1.parts.bits_15_8;
-		si->m[0].r44.msx_p1_17_16 = P1.parts.bits_19_16;// Cheat (drops upper bits)
-
-		si->m[0].r49.msx_p2_7_0 = P2.parts.bits_7_0;
-		si->m[0].r48.msx_p2_15_8 = P2.parts.bits_15_8;
-		si->m[0].r47.msx_p2_19_16 = P2.parts.bits_19_16;
-
-		si->m[0].r43.msx_p3_7_0 = P3.parts.bits_7_0;
-		si->m[0].r42.msx_p3_15_8 = P3.parts.bits_15_8;
-		si->m[0].r47.msx_p3_19_16 = P3.parts.bits_19_16;
-		
-		return writebuf(si,42+msynthx*8,(uint8_t*)&si->m[0].r42,8) == 8;
-	case 1:
-		si->m[1].r46.msx_p1_7_0 = P1.parts.bits_7_0;	// Integer
-		si->m[1].r45.msx_p1_15_8 = P1.parts.bits_15_8;
-		si->m[1].r44.msx_p1_17_16 = P1.parts.bits_19_16;// Cheat (drops upper bits)
-
-		si->m[1].r49.msx_p2_7_0 = P2.parts.bits_7_0;
-		si->m[1].r48.msx_p2_15_8 = P2.parts.bits_15_8;
-		si->m[1].r47.msx_p2_19_16 = P2.parts.bits_19_16;
-
-		si->m[1].r43.msx_p3_7_0 = P3.parts.bits_7_0;
-		si->m[1].r42.msx_p3_15_8 = P3.parts.bits_15_8;
-		si->m[1].r47.msx_p3_19_16 = P3.parts.bits_19_16;
-		
-		return writebuf(si,42+msynthx*8,(uint8_t*)&si->m[1].r42,8) == 8;
-	case 2:
-		si->m[2].r46.msx_p1_7_0 = P1.parts.bits_7_0;	// Integer
-		si->m[2].r45.msx_p1_15_8 = P1.parts.bits_15_8;
-		si->m[2].r44.msx_p1_17_16 = P1.parts.bits_19_16;// Cheat (drops upper bits)
-
-		si->m[2].r49.msx_p2_7_0 = P2.parts.bits_7_0;
-		si->m[2].r48.msx_p2_15_8 = P2.parts.bits_15_8;
-		si->m[2].r47.msx_p2_19_16 = P2.parts.bits_19_16;
-
-		si->m[2].r43.msx_p3_7_0 = P3.parts.bits_7_0;
-		si->m[2].r42.msx_p3_15_8 = P3.parts.bits_15_8;
-		si->m[2].r47.msx_p3_19_16 = P3.parts.bits_19_16;
-		
-		return writebuf(si,42+msynthx*8,(uint8_t*)&si->m[2].r42,8) == 8;
-	default:
-		;
-	}
-	return false;
+	RegPatch patch;
+
+	if ( !Si5351A_encode_msynth(msynthx,A,B,C,&patch) )
+		return false;
+	return Si5351A_commit(si,&patch,1);
 }
 
 bool
@@ -411,11 +551,10 @@ Si5351A_msynth_div(Si5351A *si,short msynth,RxDiv div) {
 	regoff = msynth * 8;
 
 	mp->r44.rx_div = udiv;
-	write1(si,regoff+44,&mp->r44);
-	return true;
+	return write1(si,regoff+44,&mp->r44) >= 0;
 }
 
-void
+bool
 Si5351A_clock_intmask(Si5351A *si,int pllx,bool mask) {
 
 	switch ( pllx ) {
@@ -425,34 +564,40 @@ Si5351A_clock_intmask(Si5351A *si,int pllx,bool mask) {
 	case 1:
 		si->r2.lol_b_mask = mask;
 		break;
+	default:
+		return false;
 	}
-	write1(si,2,&si->r2);
+	return write1(si,2,&si->r2) >= 0;
 }
 
-void
+bool
 Si5351A_xtal_cap(Si5351A *si,XtalCap cap) {
 
 	si->r183.xtal_cl = (uint8_t)cap;
+	return write1(si,183,&si->r183) >= 0;
 }
 
-void
+bool
 Si5351A_pll_reset(Si5351A *si,int pllx) {
+	struct s_r177 rst = si->r177;
 
-	switch ( pllx ) {
-	case 0:
-		si->r177.plla_rst = 1;
-		break;
-	case 1:
-		si->r177.pllb_rst = 1;
-		break;
-	}
-	write1(si,177,&si->r177);
+	if ( pllx < 0 || pllx > 1 )
+		return false;
+	rst.plla_rst = pllx == 0;		// Reset bits self clear: not
+	rst.pllb_rst = pllx == 1;		// kept in the shadow
+	return write1(si,177,&rst) >= 0;
 }
 
-bool
+//////////////////////////////////////////////////////////////////////
+// Returns 1 once the PLL reset has completed, 0 while it is still in
+// progress and -1 when r177 could not be read (see Si5351A_status()).
+//////////////////////////////////////////////////////////////////////
+
+int
 Si5351A_pll_is_reset(Si5351A *si,int pllx) {
 
-	read1(si,177,&si->r177);
+	if ( read1(si,177,&si->r177) < 0 )
+		return -1;
 
 	if ( pllx == 0 )
 		return !si->r177.plla_rst;
@@ -462,84 +607,44 @@ Si5351A_pll_is_reset(Si5351A *si,int pllx) {
 
 bool
 Si5351A_set_pll(Si5351A *si,short pllx,uint32_t A,uint32_t B,uint32_t C) {
-	u_value P1, P2, P3;
+	RegPatch patch;
 
-	P2.u = (128u * B) % C;
-	P1.u = 128u * A;
-	P1.u += (128 * B / C);
-	P1.u -= 512;
-	P3.u = C;
-
-	if ( pllx < 0 || pllx > 1 )
+	if ( !Si5351A_encode_pll(pllx,A,B,C,&patch) )
 		return false;
-
-	//////////////////////////////////////////////////////////////
-	// Unfortunately, due to an ARM gcc bug, we cannot take an
-	// address of &si->pll[plx] correctly. So use the switch
-	// statement below to generate correct code.
-	// gcc (Raspbian 6.3.0-18+rpi1+deb9u1) 6.3.0 20170516
-	//////////////////////////////////////////////////////////////
-
-	switch ( pllx ) {
-	case 0:
-		si->pll[0].r30.msnx_p1_7_0 = P1.parts.bits_7_0;	// Integer
-		si->pll[0].r29.msnx_p1_15_8 = P1.parts.bits_15_8;
-		si->pll[0].r28.msnx_p1_17_16 = P1.parts.bits_19_16; // Cheat (drops high order bits)
-
-		si->pll[0].r33.msnx_p2_7_0 = P2.parts.bits_7_0;	// Numerator
-		si->pll[0].r32.msnx_p2_15_8 = P2.parts.bits_15_8;
-		si->pll[0].r31.msnx_p2_19_16 = P2.parts.bits_19_16;
-
-		si->pll[0].r27.msnx_p3_7_0 = P3.parts.bits_7_0;	// Denominator
-		si->pll[0].r26.msnx_p3_15_8 = P3.parts.bits_15_8;
-		si->pll[0].r31.msnx_p3_19_16 = P3.parts.bits_19_16;
-		return writebuf(si,26,(uint8_t*)&si->pll[0].r26,8) == 8;
-
-	case 1:
-		si->pll[1].r30.msnx_p1_7_0 = P1.parts.bits_7_0;	// Integer
-		si->pll[1].r29.msnx_p1_15_8 = P1.parts.bits_15_8;
-		si->pll[1].r28.msnx_p1_17_16 = P1.parts.bits_19_16; // Cheat (drops high order bits)
-
-		si->pll[1].r33.msnx_p2_7_0 = P2.parts.bits_7_0;	// Numerator
-		si->pll[1].r32.msnx_p2_15_8 = P2.parts.bits_15_8;
-		si->pll[1].r31.msnx_p2_19_16 = P2.parts.bits_19_16;
-
-		si->pll[1].r27.msnx_p3_7_0 = P3.parts.bits_7_0;	// Denominator
-		si->pll[1].r26.msnx_p3_15_8 = P3.parts.bits_15_8;
-		si->pll[1].r31.msnx_p3_19_16 = P3.parts.bits_19_16;
-
-		return writebuf(si,26,(uint8_t*)&si->pll[1].r26,8) == 8;
-
-	default:
-		;
-	}
-
-	return false;
+	return Si5351A_commit(si,&patch,1);
 }
 
+#ifndef SI5351A_NO_PHASE
 bool
 Si5351A_set_phase(Si5351A *si,int clockx,unsigned phase) {
 
 	switch ( clockx ) {
 	case 0:
 		si->r165.clkx_phoff = phase;
-		return write1(si,165,&si->r165) == 1;
+		return write1(si,165,&si->r165) >= 0;
 	case 1:
 		si->r166.clkx_phoff = phase;
-		return write1(si,166,&si->r166) == 1;
+		return write1(si,166,&si->r166) >= 0;
 	case 2:
 		si->r167.clkx_phoff = phase;
-		return write1(si,167,&si->r167) == 1;
+		return write1(si,167,&si->r167) >= 0;
 	default:
 		;
 	}
 	return false;
 }
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Returns true when the PLL has lost lock. A failed read of r0 also
+// returns true: lock cannot be confirmed (see Si5351A_status()).
+//////////////////////////////////////////////////////////////////////
 
 bool
 Si5351A_is_lol(Si5351A *si,int pllx) {
 
-	read1(si,0,&si->r0);
+	if ( read1(si,0,&si->r0) < 0 )
+		return true;			// Fail safe: not known locked
 	switch ( pllx ) {
 	case 0:
 		return si->r0.lol_a;
@@ -550,48 +655,2270 @@ Si5351A_is_lol(Si5351A *si,int pllx) {
 	return false;
 }
 
-void
-Si5351A_device_reset(Si5351A *si,XtalCap cap) {
-
-	while ( Si5351A_is_busy(si) )
-		;
-	read_all(si);	
-	si->r183.b01001 = 0b01001;		// Datasheet errata says this is correct value for r183
+//////////////////////////////////////////////////////////////////////
+// Device reset as a state machine. Each Si5351A_reset_step() runs
+// until the device makes it wait (SYS_INIT, PLL reset) and returns 1
+// after that one poll, so that a caller can work on other devices in
+// the meantime. Returns 0 when done, -1 on failure (see
+// Si5351A_status()).
+//////////////////////////////////////////////////////////////////////
 
-	Si5351A_pll_reset(si,0);
-	si->r177.plla_rst = 1;
+void
+Si5351A_reset_begin(Si5351A *si,XtalCap cap) {
 
-	while ( !Si5351A_pll_is_reset(si,0) );
+	si->reset_state = ResetBusy;
+	si->reset_cap = cap;
+}
 
-	Si5351A_pll_reset(si,1);
-	si->r177.pllb_rst = 1;
-	while ( !Si5351A_pll_is_reset(si,1) );
-	
-	while ( !Si5351A_pll_is_reset(si,0) );
-	while ( !Si5351A_pll_is_reset(si,1) );
-	write1(si,177,&si->r177);
+static bool
+reset_config(Si5351A *si) {
+	bool ok;
 
-	for ( int clockx=0; clockx<3; ++clockx ) {
-		Si5351A_clock_enable_pin(si,clockx,false);
-		Si5351A_clock_enable(si,clockx,false);
-		Si5351A_clock_power(si,clockx,false);
-	}
-	Si5351A_clock_intmask(si,0,true);
-	Si5351A_clock_intmask(si,1,true);
-	Si5351A_xtal_cap(si,cap);
+	// Outputs off and disabled, OEB pin ignored, interrupts masked:
+	si->r3.clk0_oeb = si->r3.clk1_oeb = si->r3.clk2_oeb = 1;
+	si->r9.oeb_clk0 = si->r9.oeb_clk1 = si->r9.oeb_clk2 = 1;
+	si->r2.lol_a_mask = si->r2.lol_b_mask = 1;
+	si->r183.xtal_cl = si->reset_cap;
 
 	// Only choice for Si5351A:
 	si->r15.pllb_src = 0;		// XTAL
 	si->r15.plla_src = 0;		// XTAL
-	write1(si,15,&si->r15);
 
 	for ( int clockx=0; clockx<3; ++clockx ) {
-		Si5351A_clock_msynth(si,clockx,FractionalMode);
-		Si5351A_clock_polarity(si,clockx,false);
-		Si5351A_clock_source(si,clockx,MSynth_Source);
-		Si5351A_clock_drive(si,clockx,Drive6mA);
-		Si5351A_clock_disable_state(si,clockx,DisHiZ);
+		struct s_r16 *ctl = (struct s_r16 *)clock_ctl(si,clockx);
+
+		ctl->clkx_pdn = 1;
+		ctl->msx_int = 0;		// FractionalMode
+		ctl->clkx_inv = 0;
+		ctl->clkx_src = MSynth_Source;
+		ctl->clkx_idrv = Drive6mA;
+	}
+	si->r24.clk0_dis_state = si->r24.clk1_dis_state = si->r24.clk2_dis_state = DisHiZ;
+#ifndef SI5351A_NO_SPREAD
+	si->r149.ssc_en = 0;
+	si->ss_mode = SpreadOff;
+#endif
+
+	ok = write1(si,3,&si->r3) >= 0;
+	ok = write1(si,9,&si->r9) >= 0 && ok;
+	ok = writebuf(si,16,(uint8_t *)&si->r16,3) >= 0 && ok;
+	ok = write1(si,2,&si->r2) >= 0 && ok;
+	ok = write1(si,183,&si->r183) >= 0 && ok;
+	ok = write1(si,15,&si->r15) >= 0 && ok;
+	ok = write1(si,24,&si->r24) >= 0 && ok;
+#ifndef SI5351A_NO_SPREAD
+	ok = write1(si,149,&si->r149) >= 0 && ok;
+#endif
+	return ok;
+}
+
+int
+Si5351A_reset_step(Si5351A *si) {
+
+	for (;;) {
+		switch ( si->reset_state ) {
+		case ResetBusy:
+			if ( Si5351A_is_busy(si) )
+				return 1;
+			if ( si->status.err != ErrNone )
+				goto fail;
+			si->reset_state = ResetRead;
+			break;
+		case ResetRead:
+			if ( !read_all(si) )
+				goto fail;
+			si->r183.b01001 = 0b01001;	// Datasheet errata says this is correct value for r183
+			si->reset_state = ResetPllA;
+			break;
+		case ResetPllA:
+		case ResetPllB:
+			if ( !Si5351A_pll_reset(si,si->reset_state == ResetPllB) )
+				goto fail;
+			++si->reset_state;
+			break;
+		case ResetWaitA:
+		case ResetWaitB:
+			if ( read1(si,177,&si->r177) < 0 )
+				goto fail;
+			if ( si->reset_state == ResetWaitA ? si->r177.plla_rst : si->r177.pllb_rst )
+				return 1;
+			++si->reset_state;
+			break;
+		case ResetConfig:
+			if ( write1(si,177,&si->r177) < 0 || !reset_config(si) )
+				goto fail;
+			si->reset_state = ResetDone;
+			return 0;
+		case ResetDone:
+			return 0;
+		default:
+			return -1;
+		}
+	}
+
+fail:	si->reset_state = ResetFailed;
+	return -1;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Blocking reset: a device still waiting after SI5351A_RESET_POLLS
+// polls (stuck in SYS_INIT or PLL reset) fails with ErrTimeout.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_device_reset(Si5351A *si,XtalCap cap) {
+	unsigned polls = 0;
+	int rc;
+
+	Si5351A_reset_begin(si,cap);
+	while ( (rc = Si5351A_reset_step(si)) > 0 ) {
+		if ( ++polls >= SI5351A_RESET_POLLS ) {
+			si->reset_state = ResetFailed;
+			si->status.err = ErrTimeout;
+			return false;
+		}
+	}
+	return rc == 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Register image transition planning
+//
+// Compares a current and target shadow image and produces the
+// cheapest ordered write plan for the given bus cost model:
+//
+//	1. Disable outputs (r3) whose configuration changes
+//	2. Bursts of changed registers (small gaps merged when cheaper)
+//	3. Reset PLLs (r177) whose parameters changed
+//	4. Write the target r3
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_bus_cost(BusCost *cost,uint32_t bus_hz) {
+
+	cost->bus_hz = bus_hz;
+	cost->txn_bits = 1 + 9 + 1;	// START, address + ACK, STOP
+	cost->byte_bits = 9;		// 8 data bits + ACK
+	cost->txn_us = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Bus time for txns transactions carrying bytes bytes in total
+// (register address bytes included). With no bus clock set only the
+// per transaction overhead is counted.
+//////////////////////////////////////////////////////////////////////
+
+uint32_t
+Si5351A_bus_time_us(const BusCost *cost,unsigned txns,unsigned bytes) {
+	uint64_t bits = (uint64_t)txns * cost->txn_bits + (uint64_t)bytes * cost->byte_bits;
+
+	if ( !cost->bus_hz )
+		return txns * cost->txn_us;
+	return (uint32_t)((bits * 1000000u + cost->bus_hz - 1) / cost->bus_hz) + txns * cost->txn_us;
+}
+
+#ifndef SI5351A_MINIMAL
+static bool
+plan_writable(uint8_t reg) {
+
+	switch ( reg ) {
+	case 0:				// Read only status
+	case 1:				// Sticky bits: writes clear them
+	case 3:				// Output enables: sequenced separately
+	case 177:			// PLL reset: sequenced separately
+		return false;
+	default:
+		return true;
 	}
 }
+#endif
+
+#ifndef SI5351A_MINIMAL
+static bool
+reg_differs(const Si5351A *cur,const Si5351A *tgt,uint16_t offset) {
+
+	return ((const uint8_t *)cur)[offset] != ((const uint8_t *)tgt)[offset];
+}
+
+static bool
+plan_add(WritePlan *plan,const BusCost *cost,uint8_t reg,uint8_t len,StepType type,uint8_t val) {
+	PlanStep *sp;
+
+	if ( plan->n >= SI5351A_PLAN_MAX )
+		return false;
+	sp = &plan->steps[plan->n++];
+	sp->reg = reg;
+	sp->len = len;
+	sp->type = (uint8_t)type;
+	sp->val = val;
+	plan->cost_us += Si5351A_bus_time_us(cost,1,1+len);
+	return true;
+}
+
+bool
+Si5351A_plan(const Si5351A *cur,const Si5351A *tgt,const BusCost *cost,WritePlan *plan) {
+	const uint8_t *cimg = (const uint8_t *)cur, *timg = (const uint8_t *)tgt;
+	unsigned pll_rst = 0, clk_mask = 0;
+	int sreg = -1, slen = 0, gap = 0;
+	uint8_t r3, r177;
+
+	plan->n = 0;
+	plan->cost_us = 0;
+
+	// Work out which PLLs need a reset and which outputs are disturbed:
+
+	for ( unsigned x=0; regs[x].reg != 255; ++x ) {
+		uint8_t reg = regs[x].reg;
+
+		if ( !plan_writable(reg) || !reg_differs(cur,tgt,regs[x].offset) )
+			continue;
+		if ( reg == 15 )
+			pll_rst |= 0b11;
+		else if ( reg >= 26 && reg <= 33 )
+			pll_rst |= 0b01;
+		else if ( reg >= 34 && reg <= 41 )
+			pll_rst |= 0b10;
+		else if ( reg >= 16 && reg <= 18 )
+			clk_mask |= 1 << (reg - 16);
+		else if ( reg >= 42 && reg <= 65 )
+			clk_mask |= 1 << ((reg - 42) / 8);
+#ifndef SI5351A_NO_PHASE
+		else if ( reg >= 165 && reg <= 167 ) {
+			clk_mask |= 1 << (reg - 165);	// Phase offset takes effect on PLL reset
+			pll_rst |= 1 << clock_ctl(tgt,reg-165)->msx_src;
+		}
+#endif
+	}
+
+	for ( int clockx=0; clockx<3; ++clockx )
+		if ( pll_rst & (1 << clock_ctl(tgt,clockx)->msx_src) )
+			clk_mask |= 1 << clockx;
+
+	// 1. Disable disturbed outputs that are currently enabled
+
+	r3 = cimg[Offset(r3)];
+	if ( (r3 | clk_mask) != r3 ) {
+		r3 |= clk_mask;
+		if ( !plan_add(plan,cost,3,1,StepDisable,r3) )
+			return false;
+	}
+
+	// 2. Bursts of changed registers. A run of unchanged registers is
+	// written through when that costs less than a new transaction.
+
+	for ( unsigned x=0; regs[x].reg != 255; ++x ) {
+		uint8_t reg = regs[x].reg;
+		bool contiguous = sreg >= 0 && reg == sreg + slen + gap && plan_writable(reg);
+
+		if ( !reg_differs(cur,tgt,regs[x].offset) || !plan_writable(reg) ) {
+			if ( contiguous )
+				++gap;
+			else if ( sreg >= 0 ) {
+				if ( !plan_add(plan,cost,sreg,slen,StepWrite,0) )
+					return false;
+				sreg = -1;
+			}
+			continue;
+		}
+
+		if ( contiguous && gap > 0 )
+			if ( Si5351A_bus_time_us(cost,0,gap) > Si5351A_bus_time_us(cost,1,1) )
+				contiguous = false;	// New transaction (address byte) is cheaper
+
+		if ( contiguous ) {
+			slen += gap + 1;
+		} else	{
+			if ( sreg >= 0 && !plan_add(plan,cost,sreg,slen,StepWrite,0) )
+				return false;
+			sreg = reg;
+			slen = 1;
+		}
+		gap = 0;
+	}
+	if ( sreg >= 0 && !plan_add(plan,cost,sreg,slen,StepWrite,0) )
+		return false;
+
+	// 3. PLL reset after all parameters are in place
+
+	if ( pll_rst ) {
+		struct s_r177 rst = tgt->r177;
+
+		rst.plla_rst = !!(pll_rst & 0b01);
+		rst.pllb_rst = !!(pll_rst & 0b10);
+		memcpy(&r177,&rst,1);
+		if ( !plan_add(plan,cost,177,1,StepReset,r177) )
+			return false;
+	}
+
+	// 4. Final output enable state
+
+	if ( timg[Offset(r3)] != r3 )
+		if ( !plan_add(plan,cost,3,1,StepWrite,0) )
+			return false;
+
+	return true;
+}
+
+bool
+Si5351A_plan_run(Si5351A *si,const Si5351A *tgt,const WritePlan *plan) {
+	uint8_t buf[64];
+
+	for ( unsigned x=0; x < plan->n; ++x ) {
+		const PlanStep *sp = &plan->steps[x];
+
+		switch ( sp->type ) {
+		case StepDisable:
+			if ( write1(si,sp->reg,(void *)&sp->val) < 0 )
+				return false;
+			memcpy(&si->r3,&sp->val,1);
+			break;
+		case StepReset:
+			if ( write1(si,sp->reg,(void *)&sp->val) < 0 )
+				return false;
+			break;
+		default:
+			if ( sp->len > sizeof buf || sp->reg + sp->len > 256 )
+				return false;
+			for ( unsigned y=0; y < sp->len; ++y ) {
+				int off = reg_offset(sp->reg+y);
+
+				if ( off < 0 )
+					return false;	// Not in the shadow
+				buf[y] = ((const uint8_t *)tgt)[off];
+			}
+			if ( writebuf(si,sp->reg,buf,sp->len) < 0 )
+				return false;
+			for ( unsigned y=0; y < sp->len; ++y )
+				((uint8_t *)si)[reg_offset(sp->reg+y)] = buf[y];
+#ifndef SI5351A_NO_SPREAD
+			if ( !spread_follow(si,sp->reg,sp->len) )
+				return false;
+#endif
+		}
+	}
+	return true;
+}
+
+bool
+Si5351A_transition(Si5351A *si,const Si5351A *tgt,const BusCost *cost) {
+	WritePlan plan;
+
+	if ( !Si5351A_plan(si,tgt,cost,&plan) )
+		return false;
+	return Si5351A_plan_run(si,tgt,&plan);
+}
+#endif // SI5351A_MINIMAL
+
+//////////////////////////////////////////////////////////////////////
+// Frequency solving and coherent multi-output update
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_xtal_freq(Si5351A *si,uint32_t xtal_hz) {
+
+	si->xtal_hz = xtal_hz;
+}
+
+#ifndef SI5351A_MINIMAL
+void
+Si5351A_bus_config(Si5351A *si,const BusCost *cost) {
+
+	si->bus = *cost;
+}
+#endif
+
+static uint64_t
+gcd64(uint64_t a,uint64_t b) {
+
+	while ( b ) {
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Express num/den as a + b/c with c <= SI5351_PLL_C_MAX (exact when
+// the reduced fraction allows it, else rounded to the nearest 1/c).
+//////////////////////////////////////////////////////////////////////
+
+static void
+ratio(uint64_t num,uint64_t den,uint32_t *a,uint32_t *b,uint32_t *c) {
+	uint64_t rem = num % den, g;
+
+	*a = (uint32_t)(num / den);
+	if ( !rem ) {
+		*b = 0;
+		*c = 1;
+		return;
+	}
+	g = gcd64(rem,den);
+	rem /= g;
+	den /= g;
+	if ( den <= SI5351_PLL_C_MAX ) {
+		*b = (uint32_t)rem;
+		*c = (uint32_t)den;
+		return;
+	}
+	while ( den > UINT64_MAX / SI5351_PLL_C_MAX ) {
+		rem >>= 1;
+		den >>= 1;
+	}
+	*c = SI5351_PLL_C_MAX;
+	*b = (uint32_t)((rem * SI5351_PLL_C_MAX + den / 2) / den);
+	if ( *b >= *c )
+		*b = *c - 1;
+}
+
+#ifdef SI5351A_NO_HWDIV
+
+//////////////////////////////////////////////////////////////////////
+// floor(128 * B / C) and its remainder by shift and subtract, for
+// cores without a hardware divider. With B < C (always so for the
+// solvers' parameters) the quotient is under 128: seven steps.
+// Otherwise a full long division gives the same (wrapping) results
+// as the 32 bit expressions it replaces.
+//////////////////////////////////////////////////////////////////////
+
+static uint32_t
+frac128(uint32_t B,uint32_t C,uint32_t *rem) {
+	uint32_t q = 0;
+
+	if ( B < C && C <= 1u << 25 ) {
+		uint32_t r = B;
+
+		for ( unsigned x=0; x<7; ++x ) {	// Branch free
+			uint32_t ge;
+
+			r <<= 1;
+			ge = r >= C;
+			r -= C & -ge;
+			q = q << 1 | ge;
+		}
+		*rem = r;
+	} else	{
+		uint32_t n = 128u * B;
+		uint64_t r = 0;
+
+		for ( int x=31; x>=0; --x ) {
+			r = (r << 1) | ((n >> x) & 1);
+			q <<= 1;
+			if ( r >= C ) {
+				r -= C;
+				q |= 1;
+			}
+		}
+		*rem = (uint32_t)r;
+	}
+	return q;
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Encode a + b/c as P1/P2/P3 into an 8 register parameter block
+// (r26..r33 layout, also used by r42..r49). Bits that are not part
+// of P1..P3 (R divider, reserved) are preserved.
+//////////////////////////////////////////////////////////////////////
+
+static void
+encode_abc(uint8_t *p,uint32_t A,uint32_t B,uint32_t C) {
+	uint32_t P1, P2, P3;
+
+#ifdef SI5351A_NO_HWDIV
+	P1 = 128u * A + frac128(B,C,&P2) - 512;
+#else
+	P2 = (128u * B) % C;
+	P1 = 128u * A + 128u * B / C - 512;
+#endif
+	P3 = C;
+
+	p[0] = P3 >> 8;
+	p[1] = P3;
+	p[2] = (p[2] & ~0x03) | ((P1 >> 16) & 0x03);
+	p[3] = P1 >> 8;
+	p[4] = P1;
+	p[5] = ((P3 >> 12) & 0xF0) | ((P2 >> 16) & 0x0F);
+	p[6] = P2 >> 8;
+	p[7] = P2;
+}
+
+#if !defined(SI5351A_MINIMAL) || !defined(SI5351A_NO_SPREAD)
+//////////////////////////////////////////////////////////////////////
+// Inverse of encode_abc(): a + b/c as num / den.
+//////////////////////////////////////////////////////////////////////
+
+static void
+decode_abc(const uint8_t *p,uint64_t *num,uint64_t *den) {
+	uint32_t P1, P2, P3;
+
+	P1 = (uint32_t)(p[2] & 0x03) << 16 | (uint32_t)p[3] << 8 | p[4];
+	P2 = (uint32_t)(p[5] & 0x0F) << 16 | (uint32_t)p[6] << 8 | p[7];
+	P3 = (uint32_t)(p[5] >> 4) << 16 | (uint32_t)p[0] << 8 | p[1];
+
+	*num = (uint64_t)P3 * (P1 + 512) + P2;		// a + b/c = num / den
+	*den = (uint64_t)P3 * 128;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// PLL a + b/c for vco_hz from the calibrated crystal. With fixed_c
+// the denominator is held at SI5351_PLL_C_MAX so that retuning only
+// changes the numerator.
+//////////////////////////////////////////////////////////////////////
+
+static void
+pll_ratio(uint32_t xtal_hz,int32_t xtal_ppb,uint64_t vco_hz,bool fixed_c,uint32_t *a,uint32_t *b,uint32_t *c) {
+	uint64_t num = vco_hz * 1000000000u;
+	uint64_t den = (uint64_t)xtal_hz * (uint64_t)(1000000000 + (int64_t)xtal_ppb);
+	uint64_t rem, g;
+
+	if ( !fixed_c ) {
+		ratio(num,den,a,b,c);
+		return;
+	}
+
+	*a = (uint32_t)(num / den);
+	rem = num % den;
+	if ( (g = gcd64(rem,den)) > 1 ) {
+		rem /= g;
+		den /= g;
+	}
+	while ( den > UINT64_MAX / SI5351_PLL_C_MAX ) {
+		rem >>= 1;
+		den >>= 1;
+	}
+	*c = SI5351_PLL_C_MAX;
+	*b = (uint32_t)((rem * SI5351_PLL_C_MAX + den / 2) / den);
+	if ( *b >= *c )
+		*b = *c - 1;
+}
+
+static void
+pll_for_vco(const Si5351A *si,uint64_t vco_hz,bool fixed_c,uint32_t *a,uint32_t *b,uint32_t *c) {
+
+	pll_ratio(si->xtal_hz,si->xtal_ppb,vco_hz,fixed_c,a,b,c);
+}
+
+#ifndef SI5351A_MINIMAL
+//////////////////////////////////////////////////////////////////////
+// MultiSynth divider and R divider for freq_hz from a given VCO.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+solve_ms(uint32_t vco_hz,uint32_t freq_hz,FreqParams *fp) {
+
+	for ( unsigned r=0; r<8; ++r ) {
+		uint64_t frhz = (uint64_t)freq_hz << r;
+
+		ratio(vco_hz,frhz,&fp->ms_a,&fp->ms_b,&fp->ms_c);
+		if ( fp->ms_a > SI5351_MS_A_MAX || (fp->ms_a == SI5351_MS_A_MAX && fp->ms_b) )
+			continue;
+		if ( fp->ms_a < SI5351_MS_A_MIN && !(fp->ms_a == 6 && !fp->ms_b) )
+			return false;
+		fp->rdiv = (RxDiv)r;
+		fp->integer = !fp->ms_b && !(fp->ms_a & 1);
+		return true;
+	}
+	return false;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Solve for an output that owns its PLL: the MultiSynth divider is an
+// even integer and the PLL takes up the fractional part.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_solve(uint32_t xtal_hz,uint32_t freq_hz,FreqParams *fp) {
+
+	if ( freq_hz < SI5351A_FREQ_MIN || freq_hz > SI5351A_FREQ_MAX || !xtal_hz )
+		return false;
+
+	for ( unsigned r=0; r<8; ++r ) {
+		uint64_t frhz = (uint64_t)freq_hz << r;
+		uint64_t ms = (SI5351_PLL_VCO_MIN + frhz - 1) / frhz;
+
+		if ( ms > SI5351_MS_A_MAX )
+			continue;
+		ms += ms & 1;
+		if ( ms < 6 )
+			ms = 6;
+		if ( ms * frhz > SI5351_PLL_VCO_MAX )
+			return false;
+
+		fp->vco_hz = (uint32_t)(ms * frhz);
+		fp->ms_a = (uint32_t)ms;
+		fp->ms_b = 0;
+		fp->ms_c = 1;
+		fp->rdiv = (RxDiv)r;
+		fp->integer = true;
+		ratio(fp->vco_hz,xtal_hz,&fp->pll_a,&fp->pll_b,&fp->pll_c);
+		return fp->pll_a >= SI5351_PLL_A_MIN && fp->pll_a <= SI5351_PLL_A_MAX;
+	}
+	return false;
+}
+
+#ifndef SI5351A_MINIMAL
+
+//////////////////////////////////////////////////////////////////////
+// Retune up to three outputs together. All parameters are computed
+// first; then r16..r18 (if needed) and r26..r65 are written as
+// single bursts, followed by one reset of the affected PLLs. The
+// bus time used is estimated from si->bus when bus_us is given.
+//
+// The first output listed for a PLL determines its VCO (taken from
+// the integer mode index when one is in use and has an exact match,
+// giving an integer PLL ratio); other
+// outputs on the same PLL get fractional MultiSynth dividers. Outputs
+// left unchanged (freq_hz == 0) follow any retune of their PLL.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_apply_freqs(Si5351A *si,const ClockFreq cf[3],uint32_t *bus_us) {
+	Si5351A tgt = *si;
+	uint32_t vco[2] = { 0, 0 };
+	uint32_t txns = si->txns, bytes = si->bytes;
+	const uint16_t blk = Offset(pll[0].r26), blen = 65 - 26 + 1;
+	unsigned pll_rst = 0;
+	bool ok = true;
+
+	for ( int clockx=0; clockx<3; ++clockx ) {
+		struct s_r16 *ctl = (struct s_r16 *)clock_ctl(&tgt,clockx);
+		short pllx = cf[clockx].pllx;
+		FreqParams fp;
+
+		if ( !cf[clockx].freq_hz )
+			continue;
+		if ( pllx < 0 || pllx > 1 )
+			return false;
+
+		if ( !vco[pllx] ) {
+			if ( !(si->intidx && si->intidx->xtal_hz == si->xtal_hz
+			  && Si5351A_intidx_exact(si->intidx,cf[clockx].freq_hz,&fp))
+			  && !Si5351A_solve(si->xtal_hz,cf[clockx].freq_hz,&fp) )
+				return false;
+			vco[pllx] = fp.vco_hz;
+			pll_for_vco(si,fp.vco_hz,false,&fp.pll_a,&fp.pll_b,&fp.pll_c);
+			encode_abc((uint8_t *)&tgt + reg_offset(26 + pllx * 8),fp.pll_a,fp.pll_b,fp.pll_c);
+			pll_rst |= 1 << pllx;
+		} else if ( !solve_ms(vco[pllx],cf[clockx].freq_hz,&fp) )
+			return false;
+
+		encode_abc((uint8_t *)&tgt + reg_offset(42 + clockx * 8),fp.ms_a,fp.ms_b,fp.ms_c);
+		((struct s_r44 *)((uint8_t *)&tgt + reg_offset(44 + clockx * 8)))->rx_div = fp.rdiv;
+
+		ctl->msx_src = pllx;
+		ctl->msx_int = fp.integer;
+		ctl->clkx_src = MSynth_Source;
+		ctl->clkx_pdn = 0;
+	}
+
+	if ( memcmp(&si->r16,&tgt.r16,3) ) {
+		memcpy(&si->r16,&tgt.r16,3);
+		ok = writebuf(si,16,(uint8_t *)&si->r16,3) >= 0;
+	}
+
+	memcpy((uint8_t *)si + blk,(uint8_t *)&tgt + blk,blen);
+	for ( int pllx=0; pllx<2; ++pllx )
+		if ( vco[pllx] )
+			si->vco_hz[pllx] = vco[pllx];
+	for ( int clockx=0; clockx<3; ++clockx )
+		if ( cf[clockx].freq_hz )
+			si->freq_hz[clockx] = cf[clockx].freq_hz;
+	if ( ok )
+		ok = writebuf(si,26,(uint8_t *)si + blk,blen) >= 0;
+#ifndef SI5351A_NO_SPREAD
+	if ( ok )
+		ok = spread_follow(si,26,blen);
+#endif
+
+	if ( ok && pll_rst ) {
+		struct s_r177 rst = si->r177;
+
+		rst.plla_rst = !!(pll_rst & 0b01);
+		rst.pllb_rst = !!(pll_rst & 0b10);
+		ok = write1(si,177,&rst) >= 0;
+	}
+
+	if ( bus_us )
+		*bus_us = Si5351A_bus_time_us(&si->bus,si->txns - txns,si->bytes - bytes);
+	return ok;
+}
+
+#endif // SI5351A_MINIMAL
+
+#ifndef SI5351A_NO_SPREAD
+//////////////////////////////////////////////////////////////////////
+// Spread spectrum (PLL A only), per AN619:
+//
+//	SSUDP = floor(Fpfd / (4 * 31500))
+//	Down:	SSDN = 64 * (a + b/c) * amp / ((1 + amp) * SSUDP)
+//	Center:	SSUP = 128 * (a + b/c) * amp / ((1 - amp) * SSUDP)
+//		SSDN = 128 * (a + b/c) * amp / ((1 + amp) * SSUDP)
+//
+// Each is sent as P1 = floor(SS), P2 = 32767 * (SS - P1), P3 = 32767.
+// Down spread leaves SSUP at 0 + 0/1. The parameters depend on the
+// PLL A ratio, so they are recomputed whenever PLL A is rewritten.
+//////////////////////////////////////////////////////////////////////
+
+#define SS_P3		32767
+#define SS_REGS		13		// r149..r161
+
+static bool
+ss_param(uint64_t num,uint64_t den,unsigned scale,uint32_t ppm,bool up,uint32_t ssudp,uint32_t *p1,uint32_t *p2) {
+	uint64_t n = num * scale * ppm;
+	uint64_t d = den * (up ? 1000000 - ppm : 1000000 + ppm) * ssudp;
+	uint64_t rem;
+
+	if ( n / d > 0x0FFF )
+		return false;
+	*p1 = (uint32_t)(n / d);
+	rem = n % d;
+	while ( d > UINT64_MAX / SS_P3 ) {
+		rem >>= 1;
+		d >>= 1;
+	}
+	*p2 = (uint32_t)(rem * SS_P3 / d);
+	return true;
+}
+
+static bool
+spread_image(const Si5351A *si,SpreadMode mode,uint32_t ppm,bool on,uint8_t *img) {
+	uint32_t ssudp = si->xtal_hz / (4 * 31500);
+	uint32_t dn_p1, dn_p2, dn_p3 = SS_P3, up_p1 = 0, up_p2 = 0, up_p3 = 1;
+	uint64_t num, den;
+
+	decode_abc((const uint8_t *)si + reg_offset(26),&num,&den);
+	if ( !den || !ssudp || ssudp > 0x0FFF )
+		return false;
+	if ( mode == SpreadCenter ) {
+		if ( !ss_param(num,den,128,ppm,true,ssudp,&up_p1,&up_p2) )
+			return false;
+		if ( !ss_param(num,den,128,ppm,false,ssudp,&dn_p1,&dn_p2) )
+			return false;
+		up_p3 = SS_P3;
+	} else if ( !ss_param(num,den,64,ppm,false,ssudp,&dn_p1,&dn_p2) )
+		return false;
+
+	img[0] = (on ? 0x80 : 0) | ((dn_p2 >> 8) & 0x7F);	// r149: SSC_EN
+	img[1] = dn_p2;
+	img[2] = (mode == SpreadCenter ? 0x80 : 0) | ((dn_p3 >> 8) & 0x7F);
+	img[3] = dn_p3;
+	img[4] = dn_p1;
+	img[5] = ((ssudp >> 4) & 0xF0) | ((dn_p1 >> 8) & 0x0F);
+	img[6] = ssudp;
+	img[7] = (up_p2 >> 8) & 0x7F;
+	img[8] = up_p2;
+	img[9] = (up_p3 >> 8) & 0x7F;
+	img[10] = up_p3;
+	img[11] = up_p1;
+	img[12] = (up_p1 >> 8) & 0x0F;				// r161: SS_NCLK = 0
+	return true;
+}
+
+static bool
+spread_write(Si5351A *si,const uint8_t *img) {
+	uint8_t *shadow = (uint8_t *)si + reg_offset(149);
+
+	if ( !memcmp(shadow,img,SS_REGS) )
+		return true;
+	if ( writebuf(si,149,img,SS_REGS) < 0 )
+		return false;
+	memcpy(shadow,img,SS_REGS);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Registers reg..reg+len-1 were written: if they include PLL A and
+// spread is configured, bring r149..r161 in line with the new ratio.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+spread_follow(Si5351A *si,uint8_t reg,unsigned len) {
+	uint8_t img[SS_REGS];
+
+	if ( si->ss_mode == SpreadOff || reg > 33 || reg + len <= 26 )
+		return true;
+	if ( !spread_image(si,si->ss_mode,si->ss_ppm,si->r149.ssc_en,img) )
+		return false;
+	return spread_write(si,img);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Configure and enable spread spectrum on PLL A from its current
+// ratio: ppm is the total spread below PLL A (SpreadDown, up to
+// 25000) or the spread either side of it (SpreadCenter, up to 15000).
+// All 13 registers go out in one burst. SpreadOff disables it.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_spread(Si5351A *si,SpreadMode mode,uint32_t ppm) {
+	uint8_t img[SS_REGS];
+
+	if ( mode == SpreadOff ) {
+		si->ss_mode = SpreadOff;
+		return Si5351A_spread_enable(si,false);
+	}
+	if ( (mode != SpreadDown && mode != SpreadCenter) || !ppm )
+		return false;
+	if ( ppm > (mode == SpreadDown ? 25000u : 15000u) )
+		return false;
+	if ( !spread_image(si,mode,ppm,true,img) )
+		return false;
+	si->ss_mode = mode;
+	si->ss_ppm = ppm;
+	return spread_write(si,img);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Toggle spread spectrum with one register write, keeping the
+// parameters set up by Si5351A_spread().
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_spread_enable(Si5351A *si,bool on) {
+
+	if ( on && si->ss_mode == SpreadOff )
+		return false;
+	si->r149.ssc_en = on;
+	return write1(si,149,&si->r149) >= 0;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Write only the span of registers reg..reg+len-1 whose new values in
+// img differ from the shadow. Returns the number of registers
+// written (0 when nothing changed), or -1 on error. The shadow is
+// updated only after the write succeeds.
+//////////////////////////////////////////////////////////////////////
+
+static int
+write_changed(Si5351A *si,uint8_t reg,const uint8_t *img,unsigned len) {
+	uint8_t *shadow = (uint8_t *)si + reg_offset(reg);
+	unsigned first = 0, last = len;
+
+	while ( first < len && shadow[first] == img[first] )
+		++first;
+	if ( first >= len )
+		return 0;
+	while ( shadow[last-1] == img[last-1] )
+		--last;
+
+	if ( writebuf(si,reg+first,img+first,last-first) < 0 )
+		return -1;
+	memcpy(shadow+first,img+first,last-first);
+#ifndef SI5351A_NO_SPREAD
+	if ( !spread_follow(si,reg+first,last-first) )
+		return -1;
+#endif
+	return last - first;
+}
+
+#ifndef SI5351A_MINIMAL
+
+//////////////////////////////////////////////////////////////////////
+// Retune scheduler: the producer submits PLL parameters at any rate;
+// Si5351A_sched_poll() commits the latest one no more often than the
+// bus can sustain. Stale intermediate requests are dropped, so the
+// latency of the newest request is bounded by one interval.
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_sched_init(RetuneSched *rs,Si5351A *si,short pllx) {
+
+	memset(rs,0,sizeof *rs);
+	rs->si = si;
+	rs->pllx = pllx;
+	rs->interval_us = Si5351A_bus_time_us(&si->bus,1,1+8);	// Worst case: full PLL block
+}
+
+uint32_t
+Si5351A_sched_max_rate(const RetuneSched *rs) {
+
+	return rs->interval_us ? 1000000u / rs->interval_us : 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Feed a measured transfer time (bytes incl. register address) back
+// into the scheduler. The interval tracks a full 9 byte PLL write.
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_sched_observe(RetuneSched *rs,unsigned bytes,uint32_t elapsed_us) {
+	uint32_t est;
+
+	if ( !bytes )
+		return;
+	est = (uint32_t)((uint64_t)elapsed_us * (1+8) / bytes);
+	rs->interval_us = (rs->interval_us * 7 + est + 7) / 8;
+}
+
+void
+Si5351A_sched_submit(RetuneSched *rs,uint32_t A,uint32_t B,uint32_t C) {
+
+	if ( rs->pending )
+		++rs->dropped;
+	rs->A = A;
+	rs->B = B;
+	rs->C = C;
+	rs->pending = true;
+	++rs->submitted;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Returns 1 when a request was committed, 0 when idle or rate limited
+// and -1 on an I/O error. A failed request stays pending and is
+// retried on the next poll.
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_sched_poll(RetuneSched *rs,uint32_t now_us) {
+	Si5351A *si = rs->si;
+	uint8_t reg = 26 + rs->pllx * 8, img[8];
+
+	if ( rs->pllx < 0 || rs->pllx > 1 )
+		return -1;
+	if ( !rs->pending || (rs->committed && now_us - rs->last_us < rs->interval_us) )
+		return 0;
+
+	memcpy(img,(uint8_t *)si + reg_offset(reg),sizeof img);
+	encode_abc(img,rs->A,rs->B,rs->C);
+	if ( write_changed(si,reg,img,sizeof img) < 0 )
+		return -1;
+	si->vco_hz[rs->pllx] = 0;
+	rs->pending = false;
+	rs->last_us = now_us;
+	++rs->committed;
+	return 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Frequency sweeps
+//
+// The MultiSynth (even integer) and R divider stay fixed while the VCO
+// range allows; each point then only changes the PLL numerator (the
+// denominator is held at SI5351_PLL_C_MAX), so typically only the
+// trailing P1/P2 registers are written. Crossing a VCO limit selects
+// a new MultiSynth divider, chosen to cover as much of the remaining
+// sweep as possible, and resets the PLL.
+//
+// Points are stepped in integer math: linear sweeps add a fixed
+// quotient and carry the remainder, log sweeps multiply a fixed point
+// frequency (32 fraction bits) by a ratio (48 fraction bits) found
+// once per sweep.
+//////////////////////////////////////////////////////////////////////
+
+#define SWEEP_QF	32		// Frequency fraction bits
+#define SWEEP_QR	48		// Ratio fraction bits
+#define SWEEP_ONE	((uint64_t)1 << SWEEP_QR)
+
+//////////////////////////////////////////////////////////////////////
+// (a * b) >> s for 0 < s < 64, saturating at UINT64_MAX.
+//////////////////////////////////////////////////////////////////////
+
+static uint64_t
+mul_shr(uint64_t a,uint64_t b,unsigned s) {
+	uint64_t ah = a >> 32, al = a & 0xFFFFFFFF, bh = b >> 32, bl = b & 0xFFFFFFFF;
+	uint64_t lo = al * bl, m1 = ah * bl, m2 = al * bh, hi = ah * bh;
+	uint64_t mid = (lo >> 32) + (m1 & 0xFFFFFFFF) + (m2 & 0xFFFFFFFF);
+
+	hi += (m1 >> 32) + (m2 >> 32) + (mid >> 32);
+	lo = mid << 32 | (lo & 0xFFFFFFFF);
+	if ( hi >> s )
+		return UINT64_MAX;
+	return hi << (64 - s) | lo >> s;
+}
+
+static uint64_t
+pow_ratio(uint64_t x,unsigned n) {
+	uint64_t r = SWEEP_ONE;
+
+	for ( ; n; n >>= 1, x = mul_shr(x,x,SWEEP_QR) )
+		if ( n & 1 )
+			r = mul_shr(r,x,SWEEP_QR);
+	return r;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Step ratio for a log sweep: the value whose nth power is nearest to
+// stop_hz / start_hz. Below 60000:1 this fits with SWEEP_QR bits.
+//////////////////////////////////////////////////////////////////////
+
+static uint64_t
+sweep_ratio(uint32_t start_hz,uint32_t stop_hz,unsigned n) {
+	uint64_t q = ((uint64_t)stop_hz << 32) / start_hz;
+	uint64_t rem = ((uint64_t)stop_hz << 32) % start_hz;
+	uint64_t x = q << (SWEEP_QR - 32) | (rem << (SWEEP_QR - 32)) / start_hz;
+	uint64_t lo = x < SWEEP_ONE ? x : SWEEP_ONE, hi = x < SWEEP_ONE ? SWEEP_ONE : x;
+
+	while ( lo < hi ) {
+		uint64_t mid = lo + (hi - lo + 1) / 2;
+
+		if ( pow_ratio(mid,n) <= x )
+			lo = mid;
+		else	hi = mid - 1;
+	}
+	if ( pow_ratio(lo+1,n) - x < x - pow_ratio(lo,n) )
+		return lo + 1;
+	return lo;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Choose an even integer MultiSynth and R divider for freq_hz, leaving
+// the most VCO headroom in the direction of the sweep.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+sweep_factor(uint32_t freq_hz,bool up,uint32_t *ms,unsigned *r) {
+
+	for ( *r=0; *r<8; ++*r ) {
+		uint64_t frhz = (uint64_t)freq_hz << *r;
+		uint64_t m = up ? (SI5351_PLL_VCO_MIN + frhz - 1) / frhz : SI5351_PLL_VCO_MAX / frhz;
+
+		if ( up )
+			m += m & 1;
+		else	m &= ~(uint64_t)1;
+		if ( m > SI5351_MS_A_MAX ) {
+			if ( up )
+				continue;
+			m = SI5351_MS_A_MAX;
+		}
+		if ( m < 6 || m * frhz < SI5351_PLL_VCO_MIN || m * frhz > SI5351_PLL_VCO_MAX )
+			continue;
+		*ms = (uint32_t)m;
+		return true;
+	}
+	return false;
+}
+
+int
+Si5351A_sweep(Si5351A *si,const Sweep *sw) {
+	const uint8_t preg = 26 + sw->pllx * 8, mreg = 42 + sw->clockx * 8;
+	bool up = sw->stop_hz >= sw->start_hz;
+	uint32_t span = up ? sw->stop_hz - sw->start_hz : sw->start_hz - sw->stop_hz;
+	uint32_t lin_q = 0, lin_r = 0, lin_acc = 0, lin_f = sw->start_hz;
+	uint64_t log_q = 0, log_f = (uint64_t)sw->start_hz << SWEEP_QF;
+	uint32_t ms = 0;
+	unsigned r = 0;
+	uint8_t img[8];
+
+	if ( sw->points < 2 || sw->clockx < 0 || sw->clockx > 2 || sw->pllx < 0 || sw->pllx > 1 )
+		return -1;
+	if ( sw->start_hz < SI5351A_FREQ_MIN || sw->stop_hz < SI5351A_FREQ_MIN
+	  || sw->start_hz > SI5351A_FREQ_MAX || sw->stop_hz > SI5351A_FREQ_MAX )
+		return -1;
+
+	if ( sw->log )
+		log_q = sweep_ratio(sw->start_hz,sw->stop_hz,sw->points - 1);
+	else	{
+		lin_q = span / (sw->points - 1);
+		lin_r = span % (sw->points - 1);
+		lin_acc = (sw->points - 1) / 2;		// Round to nearest Hz
+	}
+
+	for ( unsigned pointx=0; pointx < sw->points; ++pointx ) {
+		uint32_t freq_hz = sw->log ? (uint32_t)((log_f + (1u << (SWEEP_QF - 1))) >> SWEEP_QF) : lin_f;
+		uint64_t vco = (uint64_t)freq_hz * ms << r;
+		bool refactor = !ms || vco < SI5351_PLL_VCO_MIN || vco > SI5351_PLL_VCO_MAX;
+		uint32_t a, b, c;
+
+		if ( refactor ) {
+			struct s_r16 ctl = *clock_ctl(si,sw->clockx);
+			struct s_r44 *r44 = (struct s_r44 *)(img + 2);
+
+			if ( !sweep_factor(freq_hz,up,&ms,&r) )
+				return -1;
+			vco = (uint64_t)freq_hz * ms << r;
+
+			ctl.msx_src = sw->pllx;
+			ctl.msx_int = 1;
+			ctl.clkx_src = MSynth_Source;
+			ctl.clkx_pdn = 0;
+			if ( memcmp(&ctl,clock_ctl(si,sw->clockx),1) ) {
+				memcpy((void *)clock_ctl(si,sw->clockx),&ctl,1);
+				if ( write1(si,16+sw->clockx,&ctl) < 0 )
+					return -1;
+			}
+
+			memcpy(img,(uint8_t *)si + reg_offset(mreg),sizeof img);
+			encode_abc(img,ms,0,1);
+			r44->rx_div = r;
+			if ( write_changed(si,mreg,img,sizeof img) < 0 )
+				return -1;
+		}
+
+		pll_for_vco(si,vco,true,&a,&b,&c);
+		memcpy(img,(uint8_t *)si + reg_offset(preg),sizeof img);
+		encode_abc(img,a,b,c);
+		si->vco_hz[sw->pllx] = (uint32_t)vco;
+		si->freq_hz[sw->clockx] = freq_hz;
+		if ( write_changed(si,preg,img,sizeof img) < 0 )
+			return -1;
+
+		if ( refactor ) {
+			struct s_r177 rst = si->r177;
+
+			rst.plla_rst = sw->pllx == 0;
+			rst.pllb_rst = sw->pllx == 1;
+			if ( write1(si,177,&rst) < 0 )
+				return -1;
+		}
+
+		if ( sw->cb && !sw->cb(sw->arg,pointx,freq_hz) )
+			return pointx + 1;
+
+		if ( pointx + 2 == sw->points ) {
+			log_f = (uint64_t)sw->stop_hz << SWEEP_QF;	// Land exactly on stop_hz
+			lin_f = sw->stop_hz;
+		} else if ( sw->log ) {
+			log_f = mul_shr(log_f,log_q,SWEEP_QR);
+		} else	{
+			uint32_t step = lin_q;
+
+			if ( (lin_acc += lin_r) >= sw->points - 1 ) {
+				lin_acc -= sw->points - 1;
+				++step;
+			}
+			lin_f = up ? lin_f + step : lin_f - step;
+		}
+	}
+	return sw->points;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Read back verification and drift monitoring
+//
+// Configured registers are read back in bursts (runs of consecutive
+// shadowed registers) and compared with the shadow. Status (r0, r1)
+// and the self clearing PLL reset register (r177) are not checked.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+verify_reg(uint8_t reg) {
+
+	return reg != 0 && reg != 1 && reg != 177;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Next run of at most max consecutive verifiable registers, starting
+// at regs[*x]. Returns the run length (0 when done).
+//////////////////////////////////////////////////////////////////////
+
+static unsigned
+next_run(unsigned *x,unsigned max,uint8_t *reg) {
+	unsigned len = 0;
+
+	while ( regs[*x].reg != 255 && !verify_reg(regs[*x].reg) )
+		++*x;
+	if ( regs[*x].reg == 255 )
+		return 0;
+
+	*reg = regs[*x].reg;
+	do	{
+		++len;
+		++*x;
+	} while ( len < max && regs[*x].reg == *reg + len && verify_reg(regs[*x].reg) );
+	return len;
+}
+
+static uint32_t
+fnv1a(uint32_t h,const uint8_t *buf,unsigned len) {
+
+	while ( len-- ) {
+		h ^= *buf++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+#define FNV_BASIS	2166136261u
+
+//////////////////////////////////////////////////////////////////////
+// Hash of the verifiable shadow registers, in register order. Equal
+// to Monitor.pass_hash when the device matches the shadow.
+//////////////////////////////////////////////////////////////////////
+
+uint32_t
+Si5351A_image_hash(const Si5351A *si) {
+	uint32_t h = FNV_BASIS;
+
+	for ( unsigned x=0; regs[x].reg != 255; ++x )
+		if ( verify_reg(regs[x].reg) )
+			h = fnv1a(h,(const uint8_t *)si + regs[x].offset,1);
+	return h;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Shadow image by register number. Registers not shadowed read as 0
+// and are clear in the known bitmap.
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_image(const Si5351A *si,uint8_t img[256],uint8_t known[32]) {
+
+	memset(img,0,256);
+	memset(known,0,32);
+	for ( unsigned x=0; regs[x].reg != 255; ++x ) {
+		img[regs[x].reg] = ((const uint8_t *)si)[regs[x].offset];
+		known[regs[x].reg >> 3] |= 1 << (regs[x].reg & 7);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Read back one run and compare with the shadow. Differing register
+// numbers are appended to diffs[*ndiffs] (up to maxdiffs).
+//////////////////////////////////////////////////////////////////////
+
+static int
+verify_run(Si5351A *si,uint8_t reg,unsigned len,uint8_t *buf,uint8_t *diffs,unsigned maxdiffs,unsigned *ndiffs) {
+
+	if ( readbuf(si,reg,buf,len) < 0 )
+		return -1;
+	for ( unsigned y=0; y<len; ++y ) {
+		if ( buf[y] == ((uint8_t *)si)[reg_offset(reg+y)] )
+			continue;
+		if ( *ndiffs < maxdiffs )
+			diffs[*ndiffs] = reg + y;
+		++*ndiffs;
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Verify all configured registers. Returns the number of registers
+// that differ from the shadow (the first maxdiffs of them are listed
+// in diffs), or -1 on an I/O error.
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_verify(Si5351A *si,uint8_t *diffs,unsigned maxdiffs) {
+	unsigned x = 0, len, ndiffs = 0;
+	uint8_t reg, buf[64];
+
+	while ( (len = next_run(&x,sizeof buf,&reg)) != 0 )
+		if ( verify_run(si,reg,len,buf,diffs,maxdiffs,&ndiffs) < 0 )
+			return -1;
+	return ndiffs;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Background monitor: each poll reads at most SI5351A_MON_CHUNK
+// registers, and only when the monitor's share of bus time (duty_pm
+// per mille of elapsed time) allows it.
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_monitor_init(Monitor *mon,Si5351A *si,uint16_t duty_pm,uint32_t now_us) {
+
+	memset(mon,0,sizeof *mon);
+	mon->si = si;
+	mon->duty_pm = duty_pm;
+	mon->last_us = now_us;
+	mon->hash = FNV_BASIS;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Returns the number of differing registers found by this poll (the
+// first maxdiffs listed in diffs), 0 when nothing was read or all
+// matched, or -1 on an I/O error.
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_monitor_poll(Monitor *mon,uint32_t now_us,uint8_t *diffs,unsigned maxdiffs) {
+	Si5351A *si = mon->si;
+	unsigned x = mon->regx, len, ndiffs = 0;
+	uint32_t cost, max_credit;
+	uint8_t reg, buf[SI5351A_MON_CHUNK];
+
+	cost = Si5351A_bus_time_us(&si->bus,2,1+SI5351A_MON_CHUNK);
+	max_credit = 2 * cost;
+	mon->credit_us += (uint32_t)((uint64_t)(now_us - mon->last_us) * mon->duty_pm / 1000u);
+	if ( mon->credit_us > max_credit )
+		mon->credit_us = max_credit;
+	mon->last_us = now_us;
+
+	if ( (len = next_run(&x,SI5351A_MON_CHUNK,&reg)) == 0 ) {
+		mon->pass_hash = mon->hash;
+		mon->hash = FNV_BASIS;
+		++mon->passes;
+		mon->regx = x = 0;
+		len = next_run(&x,SI5351A_MON_CHUNK,&reg);
+	}
+
+	cost = Si5351A_bus_time_us(&si->bus,2,1+len);
+	if ( mon->credit_us < cost )
+		return 0;
+
+	if ( verify_run(si,reg,len,buf,diffs,maxdiffs,&ndiffs) < 0 )
+		return -1;
+	mon->credit_us -= cost;
+	mon->busy_us += cost;
+	mon->hash = fnv1a(mon->hash,buf,len);
+	mon->regx = x;
+	return ndiffs;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Shadow image decoding (no bus access)
+//
+// out = (n1/d1) * (n2/d2), reduced. Returns false when the exact
+// result does not fit; out is then rounded to micro-Hz.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+rat_mul(uint64_t n1,uint64_t d1,uint64_t n2,uint64_t d2,RatFreq *out) {
+	uint64_t g, num, den;
+
+	if ( (g = gcd64(n1,d2)) > 1 ) {
+		n1 /= g;
+		d2 /= g;
+	}
+	if ( (g = gcd64(n2,d1)) > 1 ) {
+		n2 /= g;
+		d1 /= g;
+	}
+	if ( !__builtin_mul_overflow(n1,n2,&num) && !__builtin_mul_overflow(d1,d2,&den) ) {
+		g = gcd64(num,den);
+		out->num = num / g;
+		out->den = den / g;
+		return true;
+	}
+	out->num = (uint64_t)((long double)n1 / d1 * n2 / d2 * 1000000.0L + 0.5L);
+	out->den = 1000000;
+	return false;
+}
+
+static uint32_t
+rat_hz(const RatFreq *f) {
+
+	return f->den ? (uint32_t)((f->num + f->den / 2) / f->den) : 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Decode against the calibrated crystal: xtal_hz * (1e9 + ppb) / 1e9,
+// the reference pll_ratio() solves for.
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_decode(const Si5351A *si,uint32_t xtal_hz,int32_t xtal_ppb,Decoded *dec) {
+	const uint8_t *img = (const uint8_t *)si;
+	uint8_t r3 = img[Offset(r3)];
+	RatFreq xtal;
+
+	memset(dec,0,sizeof *dec);
+	rat_mul(xtal_hz,1,(uint64_t)(1000000000 + (int64_t)xtal_ppb),1000000000,&xtal);
+
+	for ( int pllx=0; pllx<2; ++pllx ) {
+		uint64_t num, den, a;
+
+		decode_abc(img + reg_offset(26 + pllx * 8),&num,&den);
+		if ( !den ) {
+			dec->pll[pllx].flags = DecPllDiv;
+			continue;
+		}
+		if ( !rat_mul(xtal.num,xtal.den,num,den,&dec->pll[pllx].vco) )
+			dec->pll[pllx].flags |= DecInexact;
+		a = num / den;
+		if ( a < SI5351_PLL_A_MIN || a > SI5351_PLL_A_MAX )
+			dec->pll[pllx].flags |= DecPllDiv;
+		if ( dec->pll[pllx].vco.num < (uint64_t)SI5351_PLL_VCO_MIN * dec->pll[pllx].vco.den
+		  || dec->pll[pllx].vco.num > (uint64_t)SI5351_PLL_VCO_MAX * dec->pll[pllx].vco.den )
+			dec->pll[pllx].flags |= DecVcoRange;
+	}
+
+	for ( int clockx=0; clockx<3; ++clockx ) {
+		const struct s_r16 *ctl = clock_ctl(si,clockx);
+		const uint8_t *mp = img + reg_offset(42 + clockx * 8);
+		const struct s_r44 *r44 = (const struct s_r44 *)(mp + 2);
+#ifndef SI5351A_NO_PHASE
+		const struct s_r165 *ph = (const struct s_r165 *)(img + reg_offset(165 + clockx));
+#endif
+		uint64_t num, den, a;
+		bool frac;
+		uint8_t flags = 0;
+
+		dec->clk[clockx].pllx = ctl->msx_src;
+		dec->clk[clockx].rdiv = 1 << r44->rx_div;
+		if ( ctl->clkx_pdn )
+			flags |= DecPowerDown;
+		if ( r3 & (1 << clockx) )
+			flags |= DecDisabled;
+
+		switch ( ctl->clkx_src ) {
+		case XTAL_Source:
+			rat_mul(xtal.num,xtal.den,1,dec->clk[clockx].rdiv,&dec->clk[clockx].freq);
+			break;
+		case MSynth_Source:
+			flags |= dec->pll[ctl->msx_src].flags;
+			decode_abc(mp,&num,&den);
+			if ( !den || !num || (dec->pll[ctl->msx_src].flags & DecPllDiv) ) {
+				flags |= DecMsDiv;
+				break;
+			}
+			a = num / den;
+			frac = num % den != 0;
+			if ( !((a >= SI5351_MS_A_MIN && (a < SI5351_MS_A_MAX || (a == SI5351_MS_A_MAX && !frac)))
+			  || ((a == 4 || a == 6) && !frac)) )
+				flags |= DecMsDiv;
+			if ( ctl->msx_int && (frac || (a & 1)) )
+				flags |= DecIntMode;
+			if ( !rat_mul(dec->pll[ctl->msx_src].vco.num,dec->pll[ctl->msx_src].vco.den,
+			  den,num * dec->clk[clockx].rdiv,&dec->clk[clockx].freq) )
+				flags |= DecInexact;
+			break;
+		default:
+			flags |= DecSource;
+		}
+
+		dec->clk[clockx].hz = rat_hz(&dec->clk[clockx].freq);
+#ifndef SI5351A_NO_PHASE
+		if ( ctl->clkx_src == MSynth_Source && ph->clkx_phoff ) {
+			uint32_t vco_hz = rat_hz(&dec->pll[ctl->msx_src].vco);
+
+			if ( vco_hz )
+				dec->clk[clockx].phase_ps = (uint32_t)(ph->clkx_phoff * 250000000000ull / vco_hz);
+		}
+#endif
+		dec->clk[clockx].flags = flags;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Integer mode frequency index lookup (see si5351a_idx.c to build,
+// save or map an index)
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_intidx_use(Si5351A *si,const IntIndex *idx) {
+
+	si->intidx = idx;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Binary search for the entry nearest to freq_hz (null if empty).
+//////////////////////////////////////////////////////////////////////
+
+const IntEntry *
+Si5351A_intidx_nearest(const IntIndex *idx,uint32_t freq_hz) {
+	uint64_t fq = (uint64_t)freq_hz << 4;
+	uint32_t lo = 0, hi;
+
+	if ( !idx || !idx->count )
+		return 0;
+
+	hi = idx->count;
+	while ( lo < hi ) {			// First entry >= fq
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if ( idx->entries[mid].freq_q4 < fq )
+			lo = mid + 1;
+		else	hi = mid;
+	}
+	if ( lo == idx->count )
+		return &idx->entries[lo-1];
+	if ( lo > 0 && fq - idx->entries[lo-1].freq_q4 <= idx->entries[lo].freq_q4 - fq )
+		return &idx->entries[lo-1];
+	return &idx->entries[lo];
+}
+
+//////////////////////////////////////////////////////////////////////
+// The entry reaching freq_hz exactly, else null.
+//////////////////////////////////////////////////////////////////////
+
+static const IntEntry *
+intidx_entry(const IntIndex *idx,uint32_t freq_hz) {
+	const IntEntry *ep = Si5351A_intidx_nearest(idx,freq_hz);
+
+	if ( !ep || (uint64_t)idx->xtal_hz * ep->pll_a != ((uint64_t)freq_hz * ep->ms << ep->rdiv) )
+		return 0;
+	return ep;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Parameters for freq_hz when it is exactly reachable in integer
+// mode with an integer PLL ratio.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_intidx_exact(const IntIndex *idx,uint32_t freq_hz,FreqParams *fp) {
+	const IntEntry *ep = intidx_entry(idx,freq_hz);
+
+	if ( !ep )
+		return false;
+
+	fp->pll_a = ep->pll_a;
+	fp->pll_b = 0;
+	fp->pll_c = 1;
+	fp->ms_a = ep->ms;
+	fp->ms_b = 0;
+	fp->ms_c = 1;
+	fp->rdiv = (RxDiv)ep->rdiv;
+	fp->vco_hz = idx->xtal_hz * ep->pll_a;
+	fp->integer = true;
+	return true;
+}
+
+#endif // SI5351A_MINIMAL
+
+//////////////////////////////////////////////////////////////////////
+// Crystal calibration: applied by all subsequent frequency
+// computations. Si5351A_recalibrate() updates the running outputs.
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_xtal_ppb(Si5351A *si,int32_t ppb) {
+
+	si->xtal_ppb = ppb;
+}
+
+void
+Si5351A_xtal_measured(Si5351A *si,uint32_t measured_hz) {
+
+	si->xtal_ppb = (int32_t)(((int64_t)measured_hz - si->xtal_hz) * 1000000000 / si->xtal_hz);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Re-solve only the PLL parameters (the VCO targets are unchanged, so
+// the MultiSynth and R dividers stay valid) for PLLs feeding active
+// outputs, and write just the registers that changed. The PLL
+// denominator is held fixed so repeated calls normally change only
+// the numerator registers. No PLL reset is issued. Returns the number
+// of registers written, or -1.
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_recalibrate(Si5351A *si) {
+	int written = 0;
+
+	for ( int pllx=0; pllx<2; ++pllx ) {
+		uint8_t reg = 26 + pllx * 8, img[8];
+		uint32_t a, b, c;
+		bool active = false;
+		int rc;
+
+		for ( int clockx=0; clockx<3; ++clockx ) {
+			const struct s_r16 *ctl = clock_ctl(si,clockx);
+
+			if ( !ctl->clkx_pdn && ctl->clkx_src == MSynth_Source && ctl->msx_src == pllx )
+				active = true;
+		}
+		if ( !active || !si->vco_hz[pllx] )
+			continue;
+
+		pll_for_vco(si,si->vco_hz[pllx],true,&a,&b,&c);
+		memcpy(img,(uint8_t *)si + reg_offset(reg),sizeof img);
+		encode_abc(img,a,b,c);
+		if ( (rc = write_changed(si,reg,img,sizeof img)) < 0 )
+			return -1;
+		written += rc;
+	}
+	return written;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Two stage compute/commit pipeline
+//
+// The encoders are pure and reentrant: they produce RegPatch objects
+// (first register, bytes and a mask of the bits they own) without
+// touching a device, so they can run on any thread. Si5351A_commit()
+// applies patches to a device and its shadow, merging the bits a
+// patch does not own from the shadow.
+//////////////////////////////////////////////////////////////////////
+
+static void
+patch_init(RegPatch *p,uint8_t reg,uint8_t len) {
+
+	memset(p,0,sizeof *p);
+	p->reg = reg;
+	p->len = len;
+	memset(p->mask,0xFF,len);
+}
+
+bool
+Si5351A_encode_pll(short pllx,uint32_t A,uint32_t B,uint32_t C,RegPatch *p) {
+
+	if ( pllx < 0 || pllx > 1 || !C )
+		return false;
+	patch_init(p,26 + pllx * 8,8);
+	p->mask[2] = 0x03;			// r28: P1[17:16] only
+	encode_abc(p->data,A,B,C);
+	return true;
+}
+
+bool
+Si5351A_encode_msynth(short msynthx,uint32_t A,uint32_t B,uint32_t C,RegPatch *p) {
+
+	if ( msynthx < 0 || msynthx > 2 || !C )
+		return false;
+	patch_init(p,42 + msynthx * 8,8);
+	p->mask[2] = 0x03;			// r44: P1[17:16] only
+	encode_abc(p->data,A,B,C);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Si5351A_encode_freq(), taking exact integer mode parameters from
+// idx when it has them (idx may be null).
+//////////////////////////////////////////////////////////////////////
+
+static unsigned
+encode_freq(uint32_t xtal_hz,int32_t xtal_ppb,const IntIndex *idx,int clockx,short pllx,uint32_t freq_hz,RegPatch p[SI5351A_FREQ_PATCHES],uint32_t *vco_hz) {
+	struct s_r16 ctl;
+	struct s_r177 rst;
+	FreqParams fp;
+
+	if ( clockx < 0 || clockx > 2 || pllx < 0 || pllx > 1 )
+		return 0;
+#ifndef SI5351A_MINIMAL
+	if ( !(idx && idx->xtal_hz == xtal_hz && Si5351A_intidx_exact(idx,freq_hz,&fp)) )
+#else
+	(void)idx;
+#endif
+	if ( !Si5351A_solve(xtal_hz,freq_hz,&fp) )
+		return 0;
+	pll_ratio(xtal_hz,xtal_ppb,fp.vco_hz,false,&fp.pll_a,&fp.pll_b,&fp.pll_c);
+
+	Si5351A_encode_pll(pllx,fp.pll_a,fp.pll_b,fp.pll_c,&p[0]);
+
+	Si5351A_encode_msynth(clockx,fp.ms_a,fp.ms_b,fp.ms_c,&p[1]);
+	p[1].mask[2] |= 0x70;			// r44: R divider
+	((struct s_r44 *)&p[1].data[2])->rx_div = fp.rdiv;
+
+	memset(&ctl,0,sizeof ctl);
+	ctl.msx_src = pllx;
+	ctl.msx_int = fp.integer;
+	ctl.clkx_src = MSynth_Source;
+	ctl.clkx_pdn = 0;
+	patch_init(&p[2],16 + clockx,1);
+	memcpy(p[2].data,&ctl,1);
+	memset(&ctl,0,sizeof ctl);		// Bits owned by this patch:
+	ctl.msx_src = 1;
+	ctl.msx_int = 1;
+	ctl.clkx_src = 0b11;
+	ctl.clkx_pdn = 1;
+	memcpy(p[2].mask,&ctl,1);
+
+	memset(&rst,0,sizeof rst);
+	rst.plla_rst = pllx == 0;
+	rst.pllb_rst = pllx == 1;
+	patch_init(&p[3],177,1);
+	memcpy(p[3].data,&rst,1);
+	rst.plla_rst = rst.pllb_rst = 1;	// Never the other PLL's reset bit
+	memcpy(p[3].mask,&rst,1);
+
+	if ( vco_hz )
+		*vco_hz = fp.vco_hz;
+	return SI5351A_FREQ_PATCHES;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Encode everything needed to put freq_hz on clockx from PLL pllx,
+// which the output owns: PLL, MultiSynth with R divider, clock
+// control and PLL reset, in commit order. Returns the number of
+// patches (SI5351A_FREQ_PATCHES) or 0 if unreachable. If vco_hz is
+// not null it receives the chosen VCO frequency.
+//////////////////////////////////////////////////////////////////////
+
+unsigned
+Si5351A_encode_freq(uint32_t xtal_hz,int32_t xtal_ppb,int clockx,short pllx,uint32_t freq_hz,RegPatch p[SI5351A_FREQ_PATCHES],uint32_t *vco_hz) {
+
+	return encode_freq(xtal_hz,xtal_ppb,0,clockx,pllx,freq_hz,p,vco_hz);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Gather the next burst from patches p[*x..n-1]: patches covering
+// consecutive registers are merged, with unowned bits taken from the
+// shadow. Returns the burst length, or -1 for an unknown register.
+//////////////////////////////////////////////////////////////////////
+
+static int
+next_burst(Si5351A *si,const RegPatch *p,unsigned n,unsigned *x,uint8_t *buf,uint8_t *reg) {
+	unsigned len = 0;
+
+	*reg = p[*x].reg;
+	do	{
+		for ( unsigned y=0; y < p[*x].len; ++y, ++len ) {
+			int off = reg_offset(p[*x].reg + y);
+
+			if ( off < 0 )
+				return -1;
+			buf[len] = (((uint8_t *)si)[off] & ~p[*x].mask[y]) | (p[*x].data[y] & p[*x].mask[y]);
+		}
+		if ( p[*x].reg >= 26 && p[*x].reg <= 41 )
+			si->vco_hz[(p[*x].reg - 26) / 8] = 0;	// Now set directly
+		++*x;
+	} while ( *x < n && p[*x].reg == *reg + len && len + p[*x].len <= SI5351A_BURST_MAX );
+	return len;
+}
+
+static void
+burst_done(Si5351A *si,uint8_t reg,const uint8_t *buf,unsigned len) {
+
+	for ( unsigned y=0; y<len; ++y )
+		((uint8_t *)si)[reg_offset(reg+y)] = buf[y];
+	if ( reg <= 177 && reg + len > 177 )
+		si->r177.plla_rst = si->r177.pllb_rst = 0;	// Self clearing
+}
+
+//////////////////////////////////////////////////////////////////////
+// Apply patches in order. Patches covering consecutive registers are
+// sent as one burst. The shadow is updated for each burst written.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_commit(Si5351A *si,const RegPatch *p,unsigned n) {
+	uint8_t buf[SI5351A_BURST_MAX], reg;
+	int len;
+
+	for ( unsigned x=0; x<n; ) {
+		if ( (len = next_burst(si,p,n,&x,buf,&reg)) < 0 )
+			return false;
+		if ( writebuf(si,reg,buf,len) < 0 )
+			return false;
+		burst_done(si,reg,buf,len);
+#ifndef SI5351A_NO_SPREAD
+		if ( !spread_follow(si,reg,len) )
+			return false;
+#endif
+	}
+	return true;
+}
+
+#ifndef SI5351A_MINIMAL
+
+//////////////////////////////////////////////////////////////////////
+// Frequency plan cache
+//
+// Fixed capacity LRU cache of encoded Si5351A_encode_freq() results,
+// keyed by frequency, crystal, calibration, output and PLL. Storage
+// is supplied by the caller: cap entries and a slot table of nslots
+// (a power of two greater than cap, 2 * cap or more recommended).
+// Slots use linear probing; entries form a doubly linked LRU list.
+// With Si5351A_cache_use() the set_frequency calls consult it, so a
+// repeat hop is a hash lookup plus the bus write.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_cache_init(PlanCache *pc,PlanEntry *ent,unsigned cap,uint16_t *slot,unsigned nslots) {
+
+	if ( !cap || cap >= SI5351A_CACHE_NIL || nslots <= cap || nslots > 0x10000 || (nslots & (nslots - 1)) )
+		return false;
+	pc->ent = ent;
+	pc->slot = slot;
+	pc->cap = cap;
+	pc->mask = nslots - 1;
+	Si5351A_cache_clear(pc);
+	return true;
+}
+
+void
+Si5351A_cache_clear(PlanCache *pc) {
+
+	for ( unsigned x=0; x <= pc->mask; ++x )
+		pc->slot[x] = SI5351A_CACHE_NIL;
+	pc->count = 0;
+	pc->head = pc->tail = SI5351A_CACHE_NIL;
+	pc->hits = pc->misses = pc->evictions = 0;
+}
+
+void
+Si5351A_cache_use(Si5351A *si,PlanCache *pc) {
+
+	si->cache = pc;
+}
+
+static void
+lru_unlink(PlanCache *pc,uint16_t ex) {
+	PlanEntry *ep = &pc->ent[ex];
+
+	if ( ep->prev != SI5351A_CACHE_NIL )
+		pc->ent[ep->prev].next = ep->next;
+	else	pc->head = ep->next;
+	if ( ep->next != SI5351A_CACHE_NIL )
+		pc->ent[ep->next].prev = ep->prev;
+	else	pc->tail = ep->prev;
+}
+
+static void
+lru_push(PlanCache *pc,uint16_t ex) {
+	PlanEntry *ep = &pc->ent[ex];
+
+	ep->prev = SI5351A_CACHE_NIL;
+	ep->next = pc->head;
+	if ( pc->head != SI5351A_CACHE_NIL )
+		pc->ent[pc->head].prev = ex;
+	else	pc->tail = ex;
+	pc->head = ex;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Remove entry ex from the slot table, shifting later members of the
+// probe run back so that lookups need no tombstones.
+//////////////////////////////////////////////////////////////////////
+
+static void
+slot_remove(PlanCache *pc,uint16_t ex) {
+	unsigned i = pc->ent[ex].hash & pc->mask, j, k;
+
+	while ( pc->slot[i] != ex )
+		i = (i + 1) & pc->mask;
+	for ( j = i;; ) {
+		j = (j + 1) & pc->mask;
+		if ( pc->slot[j] == SI5351A_CACHE_NIL )
+			break;
+		k = pc->ent[pc->slot[j]].hash & pc->mask;
+		if ( ((j - k) & pc->mask) >= ((j - i) & pc->mask) ) {
+			pc->slot[i] = pc->slot[j];	// Home at or before i: move back
+			i = j;
+		}
+	}
+	pc->slot[i] = SI5351A_CACHE_NIL;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Plan for freq_hz on clockx from pllx: cached, or encoded and
+// inserted (evicting the least recently used entry when full).
+// Returns null if unreachable. The entry stays valid until the next
+// lookup.
+//////////////////////////////////////////////////////////////////////
+
+const PlanEntry *
+Si5351A_cache_lookup(PlanCache *pc,uint32_t xtal_hz,int32_t xtal_ppb,int clockx,short pllx,uint32_t freq_hz) {
+	PlanKey key;
+	PlanEntry *ep;
+	uint32_t h;
+	unsigned i;
+	uint16_t ex;
+
+	memset(&key,0,sizeof key);
+	key.freq_hz = freq_hz;
+	key.xtal_hz = xtal_hz;
+	key.xtal_ppb = xtal_ppb;
+	key.clockx = clockx;
+	key.pllx = pllx;
+	h = fnv1a(FNV_BASIS,(const uint8_t *)&key,sizeof key);
+
+	for ( i = h & pc->mask; (ex = pc->slot[i]) != SI5351A_CACHE_NIL; i = (i + 1) & pc->mask ) {
+		ep = &pc->ent[ex];
+		if ( ep->hash == h && !memcmp(&ep->key,&key,sizeof key) ) {
+			++pc->hits;
+			if ( pc->head != ex ) {
+				lru_unlink(pc,ex);
+				lru_push(pc,ex);
+			}
+			return ep;
+		}
+	}
+
+	++pc->misses;
+	if ( pc->count < pc->cap ) {
+		ex = pc->count;
+		ep = &pc->ent[ex];
+		if ( !(ep->n = encode_freq(xtal_hz,xtal_ppb,0,clockx,pllx,freq_hz,ep->p,&ep->vco_hz)) )
+			return 0;
+		++pc->count;
+	} else	{
+		RegPatch p[SI5351A_FREQ_PATCHES];
+		uint32_t vco_hz;
+		unsigned n;
+
+		if ( !(n = encode_freq(xtal_hz,xtal_ppb,0,clockx,pllx,freq_hz,p,&vco_hz)) )
+			return 0;
+		ex = pc->tail;
+		slot_remove(pc,ex);
+		lru_unlink(pc,ex);
+		++pc->evictions;
+		ep = &pc->ent[ex];
+		memcpy(ep->p,p,sizeof p);
+		ep->n = n;
+		ep->vco_hz = vco_hz;
+	}
+	ep->key = key;
+	ep->hash = h;
+	for ( i = h & pc->mask; pc->slot[i] != SI5351A_CACHE_NIL; i = (i + 1) & pc->mask )
+		;
+	pc->slot[i] = ex;
+	lru_push(pc,ex);
+	return ep;
+}
+
+#endif // SI5351A_MINIMAL
+
+//////////////////////////////////////////////////////////////////////
+// Patches for a set_frequency call: an exact integer mode hit in the
+// index (Si5351A_intidx_use) is encoded into p, else they come from
+// the plan cache when one is in use, else they are encoded into p.
+//////////////////////////////////////////////////////////////////////
+
+static const RegPatch *
+freq_patches(Si5351A *si,int clockx,short pllx,uint32_t freq_hz,RegPatch *p,unsigned *n,uint32_t *vco_hz) {
+#ifndef SI5351A_MINIMAL
+	const PlanEntry *ep;
+
+	if ( si->intidx && si->intidx->xtal_hz == si->xtal_hz && intidx_entry(si->intidx,freq_hz) ) {
+		if ( !(*n = encode_freq(si->xtal_hz,si->xtal_ppb,si->intidx,clockx,pllx,freq_hz,p,vco_hz)) )
+			return 0;
+		return p;
+	}
+	if ( si->cache ) {
+		if ( !(ep = Si5351A_cache_lookup(si->cache,si->xtal_hz,si->xtal_ppb,clockx,pllx,freq_hz)) )
+			return 0;
+		*n = ep->n;
+		*vco_hz = ep->vco_hz;
+		return ep->p;
+	}
+#endif
+	if ( !(*n = Si5351A_encode_freq(si->xtal_hz,si->xtal_ppb,clockx,pllx,freq_hz,p,vco_hz)) )
+		return 0;
+	return p;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Single output convenience: encode then commit.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_set_frequency(Si5351A *si,int clockx,short pllx,uint32_t freq_hz) {
+	RegPatch p[SI5351A_FREQ_PATCHES];
+	const RegPatch *pp;
+	uint32_t vco_hz;
+	unsigned n;
+
+	pp = freq_patches(si,clockx,pllx,freq_hz,p,&n,&vco_hz);
+	if ( !pp || !Si5351A_commit(si,pp,n) )
+		return false;
+	si->vco_hz[pllx] = vco_hz;
+	si->freq_hz[clockx] = freq_hz;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Ping-pong PLL hopping
+//
+// The output keeps a fixed even integer MultiSynth divider and owns
+// both PLLs. The next frequency is loaded into the idle PLL (which
+// is then reset, without disturbing the active one); the hop itself
+// is a single byte write of msx_src in r16..r18. Frequencies within
+// lo_hz..hi_hz (VCO 600..900 MHz for the chosen divider) can be
+// hopped to; the divider is chosen to put freq_hz at mid VCO range.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_hop_init(Hopper *hp,Si5351A *si,int clockx,uint32_t freq_hz) {
+	const uint64_t vco_mid = (SI5351_PLL_VCO_MIN + SI5351_PLL_VCO_MAX) / 2;
+	RegPatch p[SI5351A_FREQ_PATCHES];
+	uint64_t frhz, ms, div;
+	uint32_t a, b, c;
+	unsigned r;
+
+	if ( clockx < 0 || clockx > 2 || freq_hz < SI5351A_FREQ_MIN || freq_hz > SI5351A_FREQ_MAX )
+		return false;
+
+	for ( r=0; r<8; ++r ) {
+		frhz = (uint64_t)freq_hz << r;
+		ms = (vco_mid + frhz) / (2 * frhz) * 2;	// Nearest even divider
+		if ( ms <= SI5351_MS_A_MAX )
+			break;
+	}
+	if ( r >= 8 )
+		return false;
+	if ( ms < 6 )
+		ms = 6;
+	div = ms << r;
+	if ( div * freq_hz < SI5351_PLL_VCO_MIN || div * freq_hz > SI5351_PLL_VCO_MAX )
+		return false;
+
+	memset(hp,0,sizeof *hp);
+	hp->si = si;
+	hp->clockx = clockx;
+	hp->ms = (uint32_t)ms;
+	hp->rdiv = r;
+	hp->lo_hz = (uint32_t)((SI5351_PLL_VCO_MIN + div - 1) / div);
+	hp->hi_hz = (uint32_t)(SI5351_PLL_VCO_MAX / div);
+	if ( hp->lo_hz < SI5351A_FREQ_MIN )
+		hp->lo_hz = SI5351A_FREQ_MIN;
+	if ( hp->hi_hz > SI5351A_FREQ_MAX )
+		hp->hi_hz = SI5351A_FREQ_MAX;
+
+	// Same patches as Si5351A_encode_freq(), with our divider:
+	if ( !Si5351A_encode_freq(si->xtal_hz,si->xtal_ppb,clockx,0,freq_hz,p,0) )
+		return false;
+	pll_for_vco(si,div * freq_hz,true,&a,&b,&c);
+	Si5351A_encode_pll(0,a,b,c,&p[0]);
+	Si5351A_encode_msynth(clockx,hp->ms,0,1,&p[1]);
+	p[1].mask[2] |= 0x70;
+	((struct s_r44 *)&p[1].data[2])->rx_div = r;
+	((struct s_r16 *)&p[2].data[0])->msx_int = 1;
+	if ( !Si5351A_commit(si,p,SI5351A_FREQ_PATCHES) )
+		return false;
+
+	si->vco_hz[0] = (uint32_t)(div * freq_hz);
+	si->freq_hz[clockx] = freq_hz;
+	hp->active = 0;
+	hp->cur_hz = freq_hz;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Request the next frequency; Si5351A_hop_poll() preloads it.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_hop_next(Hopper *hp,uint32_t freq_hz) {
+
+	if ( freq_hz < hp->lo_hz || freq_hz > hp->hi_hz )
+		return false;
+	if ( freq_hz != hp->next_hz ) {
+		hp->next_hz = freq_hz;
+		hp->ready = false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Load next_hz into the idle PLL (only the changed parameter bytes
+// are written, C being fixed) and reset that PLL. Returns 1 when a
+// preload was done, 0 when there was nothing to do, -1 on error.
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_hop_poll(Hopper *hp) {
+	Si5351A *si = hp->si;
+	short idle = !hp->active;
+	uint64_t vco_hz;
+	uint8_t img[8];
+	uint32_t a, b, c;
+	RegPatch rst;
+
+	if ( !hp->next_hz || hp->ready )
+		return 0;
+
+	vco_hz = ((uint64_t)hp->next_hz * hp->ms) << hp->rdiv;
+	pll_for_vco(si,vco_hz,true,&a,&b,&c);
+	memcpy(img,&si->pll[idle],sizeof img);
+	encode_abc(img,a,b,c);
+	if ( write_changed(si,26 + idle * 8,img,sizeof img) < 0 )
+		return -1;
+	si->vco_hz[idle] = (uint32_t)vco_hz;
+
+	patch_init(&rst,177,1);
+	rst.mask[0] = 0xA0;			// Never the active PLL's reset bit
+	rst.data[0] = idle ? 0x80 : 0x20;	// pllb_rst : plla_rst
+	if ( !Si5351A_commit(si,&rst,1) )
+		return -1;
+
+	hp->ready = true;
+	++hp->preloads;
+	return 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Switch the output to the preloaded PLL: one single byte write
+// (preloading first if Si5351A_hop_poll() has not run yet).
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_hop_switch(Hopper *hp) {
+	short idle = !hp->active;
+
+	if ( !hp->next_hz )
+		return false;
+	if ( !hp->ready ) {
+		if ( Si5351A_hop_poll(hp) < 0 )
+			return false;
+		++hp->late;
+	}
+	if ( !Si5351A_clock_pll(hp->si,hp->clockx,idle) )
+		return false;
+
+	hp->active = idle;
+	hp->cur_hz = hp->next_hz;
+	hp->si->freq_hz[hp->clockx] = hp->cur_hz;
+	hp->next_hz = 0;
+	hp->ready = false;
+	++hp->hops;
+	return true;
+}
+
+bool
+Si5351A_hop(Hopper *hp,uint32_t freq_hz) {
+
+	return Si5351A_hop_next(hp,freq_hz) && Si5351A_hop_switch(hp);
+}
+
+#ifndef SI5351A_MINIMAL
+
+//////////////////////////////////////////////////////////////////////
+// Asynchronous commit
+//
+// With an async backend (Si5351A_async_backend) each burst is handed
+// to the submit callback, which returns at once and calls done(ctx,rc)
+// when the transfer completes (from an interrupt, DMA completion or
+// another thread). The callback gets its own submit_arg; si->arg stays
+// with the retry delay. The next burst is submitted from that completion.
+// A burst that rewrites PLL A is followed by the spread registers for
+// the new ratio, as in Si5351A_commit(). The AsyncOp holds all state
+// and must stay valid until op->done is called. Failed bursts are
+// retried per si->retry, without backoff. Only one AsyncOp may be in
+// flight per device.
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_async_backend(Si5351A *si,i2c_submitcb_t *submit,void *submit_arg) {
+
+	si->i2c_submit = submit;
+	si->submit_arg = submit_arg;
+}
+
+static void async_xfer_done(void *ctx,int rc);
+
+static void
+async_finish(AsyncOp *op,bool ok) {
+	Si5351A *si = op->si;
+
+	if ( ok && op->freq_hz ) {
+		si->vco_hz[op->pllx] = op->vco_hz;
+		si->freq_hz[op->clockx] = op->freq_hz;
+	}
+	op->ok = ok;
+	op->done(op->ctx,ok);
+}
+
+static void
+async_submit(AsyncOp *op) {
+	Si5351A *si = op->si;
+	int rc, len;
+
+	if ( op->x >= op->n ) {
+		async_finish(op,true);
+		return;
+	}
+	if ( (len = next_burst(si,op->patches,op->n,&op->x,op->iobuf+1,&op->iobuf[0])) < 0 ) {
+		async_finish(op,false);
+		return;
+	}
+	op->len = len;
+	op->attempt = 1;
+	++si->txns;
+	si->bytes += 1 + len;
+	if ( (rc = si->i2c_submit(si->submit_arg,si->i2c_addr,op->iobuf,1+len,async_xfer_done,op)) < 0 )
+		async_xfer_done(op,rc);
+}
+
+#ifndef SI5351A_NO_SPREAD
+
+//////////////////////////////////////////////////////////////////////
+// After the burst in op->iobuf completed: when it covered PLL A and
+// spread is configured, submit r149..r161 for the new ratio (see
+// spread_follow()). Returns 1 when submitted, 0 when nothing needs
+// writing and -1 on failure.
+//////////////////////////////////////////////////////////////////////
+
+static int
+async_spread(AsyncOp *op) {
+	Si5351A *si = op->si;
+	uint8_t reg = op->iobuf[0];
+	int rc;
+
+	if ( si->ss_mode == SpreadOff || reg > 33 || reg + op->len <= 26 )
+		return 0;
+	if ( !spread_image(si,si->ss_mode,si->ss_ppm,si->r149.ssc_en,op->iobuf+1) )
+		return -1;
+	if ( !memcmp((uint8_t *)si + reg_offset(149),op->iobuf+1,SS_REGS) )
+		return 0;
+
+	op->iobuf[0] = 149;
+	op->len = SS_REGS;
+	op->attempt = 1;
+	op->spread = true;
+	++si->txns;
+	si->bytes += 1 + SS_REGS;
+	if ( (rc = si->i2c_submit(si->submit_arg,si->i2c_addr,op->iobuf,1+SS_REGS,async_xfer_done,op)) < 0 )
+		async_xfer_done(op,rc);
+	return 1;
+}
+
+#endif
+
+static void
+async_xfer_done(void *ctx,int rc) {
+	AsyncOp *op = (AsyncOp *)ctx;
+	Si5351A *si = op->si;
+
+	if ( rc < 0 && op->attempt < si->retry.attempts[err_class(rc)] ) {
+		++op->attempt;
+		++si->txns;
+		si->bytes += 1 + op->len;
+		if ( (rc = si->i2c_submit(si->submit_arg,si->i2c_addr,op->iobuf,1+op->len,async_xfer_done,op)) >= 0 )
+			return;
+	}
+
+	io_status(si,rc,op->iobuf[0],op->len,op->attempt,true);
+	if ( rc < 0 ) {
+		async_finish(op,false);
+		return;
+	}
+	burst_done(si,op->iobuf[0],op->iobuf+1,op->len);
+#ifndef SI5351A_NO_SPREAD
+	if ( op->spread )
+		op->spread = false;
+	else if ( (rc = async_spread(op)) != 0 ) {
+		if ( rc < 0 )
+			async_finish(op,false);
+		return;				// Completes via async_xfer_done()
+	}
+#endif
+	async_submit(op);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Start committing patches (copied into op). Returns false if the
+// commit could not be started; op->done is then not called.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_commit_async(Si5351A *si,AsyncOp *op,const RegPatch *p,unsigned n,async_donecb_t *done,void *ctx) {
+
+	if ( !si->i2c_submit || n > SI5351A_ASYNC_PATCHES )
+		return false;
+	memset(op,0,sizeof *op);
+	op->si = si;
+	memcpy(op->patches,p,n * sizeof *p);
+	op->n = n;
+	op->done = done;
+	op->ctx = ctx;
+	async_submit(op);
+	return true;
+}
+
+bool
+Si5351A_set_frequency_async(Si5351A *si,AsyncOp *op,int clockx,short pllx,uint32_t freq_hz,async_donecb_t *done,void *ctx) {
+	RegPatch p[SI5351A_FREQ_PATCHES];
+	const RegPatch *pp;
+	uint32_t vco_hz;
+	unsigned n;
+
+	if ( !si->i2c_submit )
+		return false;
+	if ( !(pp = freq_patches(si,clockx,pllx,freq_hz,p,&n,&vco_hz)) )
+		return false;
+
+	memset(op,0,sizeof *op);
+	op->si = si;
+	memcpy(op->patches,pp,n * sizeof *pp);
+	op->n = n;
+	op->done = done;
+	op->ctx = ctx;
+	op->clockx = clockx;
+	op->pllx = pllx;
+	op->freq_hz = freq_hz;
+	op->vco_hz = vco_hz;
+	async_submit(op);
+	return true;
+}
+
+#endif // SI5351A_MINIMAL
 
 // End si5351a.c
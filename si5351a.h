@@ -3,8 +3,21 @@
 // Date: Fri Sep 14 21:35:50 2018   (C) ve3wwg@gmail.com
 ///////////////////////////////////////////////////////////////////////
 
+// Build switches (the library and its users must agree):
+//
+//	SI5351A_MINIMAL		Core only: init, clock controls, PLL/MultiSynth,
+//				set_frequency, hopping and calibration. Drops
+//				the planner, scheduler, sweeps, verification,
+//				decoding, index, plan cache and async backend,
+//				and the device's bus accounting and known-good
+//				bitmap. Si5351A_retry_policy() then keeps a
+//				pointer to the caller's policy.
+//	SI5351A_NO_SPREAD	No spread spectrum registers (r149..r161)
+//	SI5351A_NO_PHASE	No phase offset registers (r165..r167)
+
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,6 +25,42 @@ extern "C" {
 
 typedef int (i2c_writecb_t)(uint8_t i2c_addr,uint8_t *buf,uint8_t bytes);
 typedef int (i2c_readcb_t)(uint8_t i2c_addr,uint8_t *buf,uint8_t bytes);
+typedef void (delay_cb_t)(void *arg,uint32_t us);
+
+// Optional asynchronous backend: submit returns at once (< 0 if the
+// transfer could not be queued) and done(ctx,rc) is called later with
+// the transfer result.
+typedef void (i2c_donecb_t)(void *ctx,int rc);
+typedef int (i2c_submitcb_t)(void *arg,uint8_t i2c_addr,uint8_t *buf,uint8_t bytes,i2c_donecb_t *done,void *ctx);
+
+// i2c callbacks return < 0 on failure. These values select the
+// retry class; any other negative value is a generic I/O error.
+#define SI5351A_ENAK		(-2)	// Address or data NAK
+#define SI5351A_EARB		(-3)	// Arbitration lost
+#define SI5351A_ETIMEOUT	(-4)	// Bus timeout
+
+typedef enum {
+	ErrNone = 0,
+	ErrIO,				// Generic I/O error
+	ErrNak,				// NAK
+	ErrArb,				// Arbitration lost
+	ErrTimeout,			// Bus timeout
+	ErrClasses
+} ErrClass;
+
+typedef struct {			// Retry policy for bus transfers
+	uint8_t		attempts[ErrClasses]; // Max attempts per ErrClass (1 = no retry)
+	uint32_t	backoff_us;	// Delay before the first retry
+	uint32_t	backoff_max_us;	// Cap for the doubling backoff
+	delay_cb_t	*delay;		// Delay function (null = retry at once)
+} RetryPolicy;
+
+typedef struct {			// Outcome of the last transfer
+	uint8_t		err;		// ErrClass
+	uint8_t		reg;		// First register of the transfer
+	uint8_t		len;		// Registers in the transfer
+	uint8_t		attempts;	// Attempts made
+} IoStatus;
 
 typedef enum {
 	FractionalMode=0,
@@ -60,6 +109,58 @@ typedef enum {
 	Cap10pF = 0b11
 } XtalCap;
 
+typedef enum {
+	SpreadOff = 0,
+	SpreadDown,			// Below PLL A (set PLL A to the top)
+	SpreadCenter			// Either side of PLL A
+} SpreadMode;
+
+typedef struct {			// I2C bus cost model
+	uint32_t	bus_hz;		// SCL rate (100000, 400000 etc.)
+	uint16_t	txn_bits;	// Per transaction: START, address + ACK, STOP
+	uint16_t	byte_bits;	// Per byte: 8 data bits + ACK
+	uint32_t	txn_us;		// Host overhead per transaction (driver, syscall)
+} BusCost;
+
+typedef struct {			// Integer mode frequency index entry
+	uint32_t	freq_q4;	// Output frequency in 1/16 Hz
+	uint16_t	ms;		// Even integer MultiSynth divider
+	uint8_t		pll_a;		// Integer PLL multiplier
+	uint8_t		rdiv;		// RxDiv
+} IntEntry;
+
+typedef struct {			// Index file header
+	uint32_t	magic;		// SI5351A_IDX_MAGIC
+	uint32_t	xtal_hz;	// Crystal the index was built for
+	uint32_t	count;		// Number of IntEntry following
+	uint32_t	reserved;
+} IntIndexHdr;
+
+#define SI5351A_IDX_MAGIC	0x58495335	// "5SIX"
+
+typedef struct s_PlanCache PlanCache;
+
+typedef enum {				// Si5351A_reset_step() states
+	ResetIdle = 0,
+	ResetBusy,			// Waiting for SYS_INIT to clear
+	ResetRead,			// Reading the register image
+	ResetPllA,
+	ResetWaitA,			// Waiting for PLL A reset to complete
+	ResetPllB,
+	ResetWaitB,			// Waiting for PLL B reset to complete
+	ResetConfig,			// Writing the default configuration
+	ResetDone,
+	ResetFailed
+} ResetState;
+
+typedef struct {			// Sorted integer mode frequency index
+	uint32_t	xtal_hz;	// Crystal the index was built for
+	uint32_t	count;		// Number of entries
+	const IntEntry	*entries;	// Sorted by freq_q4
+	void		*mem;		// Allocation or mapping (if owned)
+	size_t		memlen;		// Length of mapping (0 if allocated)
+} IntIndex;
+
 struct s_Si5351A {			// Si5351A Register Definitions
 	struct s_r0 {			// Device status
 		uint8_t	revid : 2;	// R: Device revision ID
@@ -181,13 +282,13 @@ struct s_Si5351A {			// Si5351A Register Definitions
 		}	r49;
 	} m[3];					// r42..r49, r50..r57, r58..r65
 
+#ifndef SI5351A_NO_SPREAD
 	struct s_r149 {			// Spread Spectrum Parameters
 		uint8_t	ssdn_p2_14_8:7;	// PLL A Spread Spectrum Down P2
-		uint8_t	reserved : 1;
+		uint8_t	ssc_en : 1;	// 1=Spread spectrum enabled
 	}	r149;
 	struct s_r150 {			// Spread Spectrum Parameters
 		uint8_t	ssdn_p2_7_0;	// PLL A Spread Spectrum Down P2
-		uint8_t	reserved : 1;
 	}	r150;
 	struct s_r151 {			// Spread Spectrum Parameters
 		uint8_t	ssdn_p3_14_8:7; // PLL A Spread Spectrum Down P3
@@ -227,13 +328,16 @@ struct s_Si5351A {			// Si5351A Register Definitions
 		uint8_t	ssup_p1_11_8:4;	// PLL A Spread Up Spectrum P1
 		uint8_t	ss_nclk : 4;	// Must be zero
 	}	r161;
+#endif
 
+#ifndef SI5351A_NO_PHASE
 	struct s_r165 {			// Clk0 Initial Phase Offset
 		uint8_t	clkx_phoff : 6;	// RW: Time delay of Tvco/4
 		uint8_t	reserved : 1;
 	}	r165;
 	struct s_r165 r166;		// Clk1 Initial Phase Offset
 	struct s_r165 r167;		// Clk2 Initial Phase Offset
+#endif
 
 	struct s_r177 {			// PLL Reset
 		uint8_t	reserved : 5;
@@ -250,36 +354,515 @@ struct s_Si5351A {			// Si5351A Register Definitions
 	uint8_t		i2c_addr;
 	i2c_writecb_t	*i2c_write;
 	i2c_readcb_t	*i2c_read;
+#ifndef SI5351A_MINIMAL
+	i2c_submitcb_t	*i2c_submit;	// Async backend (optional)
+	void		*submit_arg;	// Its argument (Si5351A_async_backend)
+#endif
 	void		*arg;
+
+	uint32_t	xtal_hz;	// Crystal frequency (Hz)
+	int32_t		xtal_ppb;	// Crystal calibration (parts per billion)
+	uint32_t	vco_hz[2];	// Requested VCO per PLL (0 = set directly)
+	uint32_t	freq_hz[3];	// Requested frequency per output
+#ifndef SI5351A_MINIMAL
+	BusCost		bus;		// Bus cost model (Si5351A_bus_config)
+	uint32_t	txns;		// I2C transactions issued
+	uint32_t	bytes;		// I2C bytes transferred
+	RetryPolicy	retry;		// Retry policy (Si5351A_retry_policy)
+#else
+	const RetryPolicy *retry;	// Caller's retry policy (null = default)
+#endif
+	IoStatus	status;		// Last transfer outcome
+#ifndef SI5351A_MINIMAL
+	uint8_t		unknown[32];	// Registers whose last write failed (bitmap)
+#endif
+	uint8_t		reset_state;	// ResetState (Si5351A_reset_step)
+	uint8_t		reset_cap;	// XtalCap for the reset in progress
+#ifndef SI5351A_NO_SPREAD
+	uint8_t		ss_mode;	// SpreadMode (Si5351A_spread)
+	uint16_t	ss_ppm;		// Spread amount (ppm)
+#endif
+#ifndef SI5351A_MINIMAL
+	const IntIndex	*intidx;	// Integer mode index (optional)
+	PlanCache	*cache;		// Frequency plan cache (optional)
+#endif
 };
 
 typedef struct s_Si5351A Si5351A;
 
-void Si5351A_init(Si5351A *si,uint8_t i2c_addr,i2c_readcb_t readcb,i2c_writecb_t writecb,void *arg,XtalCap cap);
-void Si5351A_device_reset(Si5351A *si,XtalCap cap);
+typedef enum {
+	StepWrite = 0,			// Burst copied from target image
+	StepDisable,			// r3: Disable affected outputs first
+	StepReset			// r177: PLL soft reset (last)
+} StepType;
+
+typedef struct {
+	uint8_t		reg;		// First register of burst
+	uint8_t		len;		// Number of registers in burst
+	uint8_t		type;		// StepType
+	uint8_t		val;		// Value for StepDisable/StepReset
+} PlanStep;
+
+typedef struct {			// Computed parameters for one output
+	uint32_t	pll_a, pll_b, pll_c;	// PLL feedback a + b/c
+	uint32_t	ms_a, ms_b, ms_c;	// MultiSynth divider a + b/c
+	RxDiv		rdiv;		// Output R divider
+	uint32_t	vco_hz;		// Resulting VCO frequency
+	bool		integer;	// MultiSynth divider is an even integer
+} FreqParams;
+
+typedef struct {			// Requested frequency for one output
+	uint32_t	freq_hz;	// Output frequency (0 = leave unchanged)
+	short		pllx;		// PLL driving the output (0=A, 1=B)
+} ClockFreq;
+
+typedef struct {			// Latest-wins PLL retune scheduler
+	Si5351A		*si;
+	short		pllx;		// PLL being retuned
+	uint32_t	A, B, C;	// Latest requested parameters
+	bool		pending;	// Request waiting for the bus
+	uint32_t	last_us;	// Time of last commit
+	uint32_t	interval_us;	// Minimum interval between commits
+	uint32_t	submitted;	// Requests submitted
+	uint32_t	committed;	// Requests written to the device
+	uint32_t	dropped;	// Stale requests replaced before commit
+} RetuneSched;
+
+typedef bool (sweep_cb_t)(void *arg,unsigned pointx,uint32_t freq_hz);
+
+typedef struct {			// Frequency sweep definition
+	uint32_t	start_hz;	// First point
+	uint32_t	stop_hz;	// Last point
+	unsigned	points;		// Number of points (>= 2)
+	bool		log;		// Logarithmic (else linear) spacing
+	int		clockx;		// Output being swept
+	short		pllx;		// PLL dedicated to the sweep
+	sweep_cb_t	*cb;		// Called after each point (may be null)
+	void		*arg;		// Callback argument
+} Sweep;
+
+typedef struct {			// Low duty cycle register drift monitor
+	Si5351A		*si;
+	uint16_t	duty_pm;	// Max share of bus time (per mille)
+	uint16_t	regx;		// Next register (regs[] index)
+	uint32_t	last_us;	// Time of last poll
+	uint32_t	credit_us;	// Bus time available to the monitor
+	uint32_t	busy_us;	// Bus time used by the monitor
+	uint32_t	hash;		// Rolling hash of the pass in progress
+	uint32_t	pass_hash;	// Hash of the last completed pass
+	uint32_t	passes;		// Completed passes over all registers
+} Monitor;
+
+#define SI5351A_MON_CHUNK	8
+
+typedef struct {			// Ping-pong PLL hopper for one output
+	Si5351A		*si;
+	int		clockx;		// Output (owns both PLLs)
+	short		active;		// PLL driving the output
+	uint32_t	ms;		// Fixed even integer MultiSynth divider
+	uint8_t		rdiv;		// Fixed R divider (RxDiv)
+	uint32_t	lo_hz, hi_hz;	// Hop range (VCO limits)
+	uint32_t	cur_hz;		// Frequency on the output
+	uint32_t	next_hz;	// Requested next frequency (0 = none)
+	bool		ready;		// Idle PLL holds next_hz
+	uint32_t	hops;		// Switches performed
+	uint32_t	preloads;	// Idle PLL loads
+	uint32_t	late;		// Switches that had to preload first
+} Hopper;
+
+typedef struct {			// Exact frequency: num / den Hz
+	uint64_t	num;
+	uint64_t	den;
+} RatFreq;
+
+typedef enum {				// Decoder flags
+	DecVcoRange = 0x01,		// VCO outside 600..900 MHz
+	DecPllDiv = 0x02,		// PLL divider outside 15..90 (or P3 == 0)
+	DecMsDiv = 0x04,		// Illegal MultiSynth divider
+	DecIntMode = 0x08,		// Integer mode with non even integer divider
+	DecSource = 0x10,		// Clock source not available on Si5351A
+	DecInexact = 0x20,		// num/den rounded (exact value overflows)
+	DecPowerDown = 0x40,		// Output driver powered down
+	DecDisabled = 0x80		// Output disabled (r3)
+} DecFlags;
+
+#define DecInvalid	(DecVcoRange|DecPllDiv|DecMsDiv|DecIntMode|DecSource)
+
+typedef struct {			// Decoded shadow image
+	struct {
+		RatFreq		vco;	// VCO frequency
+		uint8_t		flags;	// DecFlags
+	}	pll[2];
+	struct {
+		RatFreq		freq;	// Output frequency
+		uint32_t	hz;	// Output frequency, rounded
+		uint32_t	phase_ps; // Initial phase offset
+		uint8_t		pllx;	// PLL feeding the MultiSynth
+		uint8_t		rdiv;	// R divider (1..128)
+		uint8_t		flags;	// DecFlags (includes those of the PLL)
+	}	clk[3];
+} Decoded;
+
+typedef struct {			// Published device state (Si5351A_shm_*)
+	uint32_t	version;	// Publication count
+	uint8_t		regs[256];	// Shadow image by register number
+	uint8_t		known[32];	// Registers present in regs[] (bitmap)
+	bool		lol[2];		// PLL loss of lock (last status poll)
+	bool		sys_init;	// Device initializing (last status poll)
+	uint32_t	xtal_hz;	// Crystal frequency
+	int32_t		xtal_ppb;	// Crystal calibration
+	uint32_t	freq_hz[3];	// Requested output frequencies
+	Decoded		dec;		// Decoded shadow image
+} DevSnapshot;
+
+typedef struct s_DevShm DevShm;
+
+typedef struct {			// One I2C bus of a fleet
+	i2c_readcb_t	*readcb;	// Callbacks get no bus argument:
+	i2c_writecb_t	*writecb;	// each bus needs its own functions
+	void		*arg;		// Passed only to the retry delay
+} FleetBus;
+
+typedef struct {			// One chip of a fleet
+	Si5351A		*si;		// Device storage
+	uint8_t		bus;		// Index of its FleetBus
+	uint8_t		i2c_addr;
+	XtalCap		cap;
+	bool		ok;		// Result: initialized
+	uint32_t	start_us;	// First bus access (from fleet start)
+	uint32_t	ready_us;	// Done or failed (from fleet start)
+	uint32_t	txns;		// I2C transactions used
+	IoStatus	status;		// Failure details
+} FleetChip;
+
+#define SI5351A_SHM_MAGIC	0x4D485335	// "5SHM"
+
+#define SI5351A_PATCH_MAX	8
+
+typedef struct {			// Register patch (encoder output)
+	uint8_t		reg;		// First register
+	uint8_t		len;		// Number of registers
+	uint8_t		data[SI5351A_PATCH_MAX]; // New register contents
+	uint8_t		mask[SI5351A_PATCH_MAX]; // Bits owned by the patch
+} RegPatch;
+
+#define SI5351A_FREQ_PATCHES	4	// PLL, MultiSynth, control, reset
+#define SI5351A_BURST_MAX	64	// Largest burst built from patches
+#define SI5351A_ASYNC_PATCHES	8
+
+typedef void (async_donecb_t)(void *ctx,bool ok);
+
+typedef struct {			// Asynchronous commit in progress
+	Si5351A		*si;
+	RegPatch	patches[SI5351A_ASYNC_PATCHES];
+	unsigned	n;		// Number of patches
+	unsigned	x;		// Next patch to send
+	uint8_t		iobuf[1+SI5351A_BURST_MAX]; // Burst in flight
+	uint8_t		len;		// Registers in burst
+	uint8_t		attempt;	// Attempt number for burst
+#ifndef SI5351A_NO_SPREAD
+	bool		spread;		// Burst is the spread follow-up (r149..r161)
+#endif
+	bool		ok;		// Result (valid once done is called)
+	int		clockx;		// Set frequency tracking (freq_hz != 0)
+	short		pllx;
+	uint32_t	freq_hz;
+	uint32_t	vco_hz;
+	async_donecb_t	*done;		// Completion callback
+	void		*ctx;
+} AsyncOp;
+
+typedef struct {			// Frequency plan cache key
+	uint32_t	freq_hz;
+	uint32_t	xtal_hz;
+	int32_t		xtal_ppb;
+	uint8_t		clockx;
+	uint8_t		pllx;
+	uint8_t		pad[2];		// Zero
+} PlanKey;
+
+typedef struct {			// Frequency plan cache entry
+	PlanKey		key;
+	uint32_t	hash;		// Hash of key
+	uint16_t	prev, next;	// LRU list (SI5351A_CACHE_NIL terminated)
+	uint32_t	vco_hz;		// VCO chosen by the plan
+	unsigned	n;		// Number of patches
+	RegPatch	p[SI5351A_FREQ_PATCHES]; // Encoded register spans
+} PlanEntry;
+
+#define SI5351A_CACHE_NIL	0xFFFF
+
+struct s_PlanCache {			// Fixed capacity LRU plan cache
+	PlanEntry	*ent;		// Entry storage (cap entries)
+	uint16_t	*slot;		// Open addressing table (entry index or NIL)
+	uint16_t	cap;		// Entry capacity
+	uint16_t	mask;		// Table size - 1 (power of two > cap)
+	uint16_t	count;		// Entries in use
+	uint16_t	head, tail;	// Most, least recently used
+	uint32_t	hits;
+	uint32_t	misses;
+	uint32_t	evictions;
+};
+
+#define SI5351A_XTAL_HZ		25000000
+#define SI5351A_FREQ_MIN	2500
+#define SI5351A_FREQ_MAX	150000000
+
+#ifndef SI5351A_RESET_POLLS
+#define SI5351A_RESET_POLLS	10000	// Si5351A_device_reset() wait limit
+#endif
+
+#define SI5351A_PLAN_MAX	40
+
+typedef struct {			// Ordered write plan: current -> target image
+	unsigned	n;		// Number of steps
+	uint32_t	cost_us;	// Estimated bus time
+	PlanStep	steps[SI5351A_PLAN_MAX];
+} WritePlan;
+
+bool Si5351A_init(Si5351A *si,uint8_t i2c_addr,i2c_readcb_t readcb,i2c_writecb_t writecb,void *arg,XtalCap cap);
+void Si5351A_attach(Si5351A *si,uint8_t i2c_addr,i2c_readcb_t readcb,i2c_writecb_t writecb,void *arg);
+bool Si5351A_device_reset(Si5351A *si,XtalCap cap);
+void Si5351A_reset_begin(Si5351A *si,XtalCap cap);
+int Si5351A_reset_step(Si5351A *si);
 bool Si5351A_is_busy(Si5351A *si);
-void Si5351A_clock_enable(Si5351A *si,int clockx,bool on);
-void Si5351A_clock_enable_pin(Si5351A *si,int clockx,bool enable);
-void Si5351A_clock_power(Si5351A *si,int clockx,bool on);
-void Si5351A_clock_msynth(Si5351A *si,int clockx,MultiSynthMode mode);
-void Si5351A_clock_polarity(Si5351A *si,int clockx,bool invert);
-void Si5351A_clock_source(Si5351A *si,int clockx,ClockSource src);
-void Si5351A_clock_pll(Si5351A *si,int clockx,int pllx);
-void Si5351A_clock_drive(Si5351A *si,int clockx,ClockDrive drv);
-void Si5351A_clock_disable_state(Si5351A *si,int clockx,DisState state);
-void Si5351A_clock_intmask(Si5351A *si,int pllx,bool mask);
+bool Si5351A_clock_enable(Si5351A *si,int clockx,bool on);
+bool Si5351A_clock_enable_pin(Si5351A *si,int clockx,bool enable);
+bool Si5351A_clock_power(Si5351A *si,int clockx,bool on);
+bool Si5351A_clock_msynth(Si5351A *si,int clockx,MultiSynthMode mode);
+bool Si5351A_clock_polarity(Si5351A *si,int clockx,bool invert);
+bool Si5351A_clock_source(Si5351A *si,int clockx,ClockSource src);
+bool Si5351A_clock_pll(Si5351A *si,int clockx,int pllx);
+bool Si5351A_clock_drive(Si5351A *si,int clockx,ClockDrive drv);
+bool Si5351A_clock_disable_state(Si5351A *si,int clockx,DisState state);
+bool Si5351A_clock_intmask(Si5351A *si,int pllx,bool mask);
 bool Si5351A_clock_invert(Si5351A *si,int clockx,bool enable);
-void Si5351A_xtal_cap(Si5351A *si,XtalCap cap);
-void Si5351A_pll_reset(Si5351A *si,int pllx);
-bool Si5351A_pll_is_reset(Si5351A *si,int pllx);
+bool Si5351A_xtal_cap(Si5351A *si,XtalCap cap);
+bool Si5351A_pll_reset(Si5351A *si,int pllx);
+int Si5351A_pll_is_reset(Si5351A *si,int pllx);
 
 bool Si5351A_set_pll(Si5351A *si,short pllx,uint32_t A,uint32_t B,uint32_t C);
 bool Si5351A_set_msynth(Si5351A *si,short msynthx,uint32_t A,uint32_t B,uint32_t C);
 bool Si5351A_msynth_div(Si5351A *si,short msynth,RxDiv div);
+#ifndef SI5351A_NO_PHASE
 bool Si5351A_set_phase(Si5351A *si,int clockx,unsigned phase);
+#endif
+#ifndef SI5351A_NO_SPREAD
+bool Si5351A_spread(Si5351A *si,SpreadMode mode,uint32_t ppm);
+bool Si5351A_spread_enable(Si5351A *si,bool on);
+#endif
 
 bool Si5351A_is_lol(Si5351A *si,int pllx);
 
+void Si5351A_retry_default(RetryPolicy *rp);
+void Si5351A_retry_policy(Si5351A *si,const RetryPolicy *rp);
+const IoStatus *Si5351A_status(const Si5351A *si);
+#ifndef SI5351A_MINIMAL
+bool Si5351A_reg_known_good(const Si5351A *si,uint8_t reg);
+#endif
+
+void Si5351A_xtal_freq(Si5351A *si,uint32_t xtal_hz);
+void Si5351A_xtal_ppb(Si5351A *si,int32_t ppb);
+void Si5351A_xtal_measured(Si5351A *si,uint32_t measured_hz);
+int Si5351A_recalibrate(Si5351A *si);
+#ifndef SI5351A_MINIMAL
+void Si5351A_bus_config(Si5351A *si,const BusCost *cost);
+#endif
+bool Si5351A_solve(uint32_t xtal_hz,uint32_t freq_hz,FreqParams *fp);
+
+#ifndef SI5351A_MINIMAL
+bool Si5351A_apply_freqs(Si5351A *si,const ClockFreq cf[3],uint32_t *bus_us);
+
+void Si5351A_sched_init(RetuneSched *rs,Si5351A *si,short pllx);
+uint32_t Si5351A_sched_max_rate(const RetuneSched *rs);
+void Si5351A_sched_observe(RetuneSched *rs,unsigned bytes,uint32_t elapsed_us);
+void Si5351A_sched_submit(RetuneSched *rs,uint32_t A,uint32_t B,uint32_t C);
+int Si5351A_sched_poll(RetuneSched *rs,uint32_t now_us);
+
+int Si5351A_sweep(Si5351A *si,const Sweep *sw);
+
+uint32_t Si5351A_image_hash(const Si5351A *si);
+void Si5351A_image(const Si5351A *si,uint8_t img[256],uint8_t known[32]);
+int Si5351A_verify(Si5351A *si,uint8_t *diffs,unsigned maxdiffs);
+void Si5351A_monitor_init(Monitor *mon,Si5351A *si,uint16_t duty_pm,uint32_t now_us);
+int Si5351A_monitor_poll(Monitor *mon,uint32_t now_us,uint8_t *diffs,unsigned maxdiffs);
+
+void Si5351A_decode(const Si5351A *si,uint32_t xtal_hz,int32_t xtal_ppb,Decoded *dec);
+
+void Si5351A_intidx_use(Si5351A *si,const IntIndex *idx);
+const IntEntry *Si5351A_intidx_nearest(const IntIndex *idx,uint32_t freq_hz);
+bool Si5351A_intidx_exact(const IntIndex *idx,uint32_t freq_hz,FreqParams *fp);
+int Si5351A_intidx_build(IntIndex *idx,uint32_t xtal_hz);
+int Si5351A_intidx_save(const IntIndex *idx,const char *path);
+int Si5351A_intidx_map(IntIndex *idx,const char *path);
+void Si5351A_intidx_free(IntIndex *idx);
+
+DevShm *Si5351A_shm_create(const char *name);
+int Si5351A_shm_publish(DevShm *shm,Si5351A *si,bool poll_status);
+DevShm *Si5351A_shm_open(const char *name);
+bool Si5351A_shm_read(const DevShm *shm,DevSnapshot *snap);
+void Si5351A_shm_close(DevShm *shm,bool unlink);
+
+int Si5351A_fleet_init(FleetChip *chips,unsigned n,const FleetBus *buses,unsigned nbuses,uint32_t timeout_us);
+#endif
+
+bool Si5351A_encode_pll(short pllx,uint32_t A,uint32_t B,uint32_t C,RegPatch *p);
+bool Si5351A_encode_msynth(short msynthx,uint32_t A,uint32_t B,uint32_t C,RegPatch *p);
+unsigned Si5351A_encode_freq(uint32_t xtal_hz,int32_t xtal_ppb,int clockx,short pllx,uint32_t freq_hz,RegPatch p[SI5351A_FREQ_PATCHES],uint32_t *vco_hz);
+bool Si5351A_commit(Si5351A *si,const RegPatch *p,unsigned n);
+bool Si5351A_set_frequency(Si5351A *si,int clockx,short pllx,uint32_t freq_hz);
+
+#ifndef SI5351A_MINIMAL
+bool Si5351A_cache_init(PlanCache *pc,PlanEntry *ent,unsigned cap,uint16_t *slot,unsigned nslots);
+void Si5351A_cache_clear(PlanCache *pc);
+void Si5351A_cache_use(Si5351A *si,PlanCache *pc);
+const PlanEntry *Si5351A_cache_lookup(PlanCache *pc,uint32_t xtal_hz,int32_t xtal_ppb,int clockx,short pllx,uint32_t freq_hz);
+#endif
+
+bool Si5351A_hop_init(Hopper *hp,Si5351A *si,int clockx,uint32_t freq_hz);
+bool Si5351A_hop_next(Hopper *hp,uint32_t freq_hz);
+int Si5351A_hop_poll(Hopper *hp);
+bool Si5351A_hop_switch(Hopper *hp);
+bool Si5351A_hop(Hopper *hp,uint32_t freq_hz);
+
+#ifndef SI5351A_MINIMAL
+void Si5351A_async_backend(Si5351A *si,i2c_submitcb_t *submit,void *submit_arg);
+bool Si5351A_commit_async(Si5351A *si,AsyncOp *op,const RegPatch *p,unsigned n,async_donecb_t *done,void *ctx);
+bool Si5351A_set_frequency_async(Si5351A *si,AsyncOp *op,int clockx,short pllx,uint32_t freq_hz,async_donecb_t *done,void *ctx);
+
+typedef struct s_I2cWorker I2cWorker;
+
+I2cWorker *Si5351A_worker_start(i2c_writecb_t *writecb,unsigned depth);
+int Si5351A_worker_submit(void *arg,uint8_t i2c_addr,uint8_t *buf,uint8_t bytes,i2c_donecb_t *done,void *ctx);
+void Si5351A_worker_stop(I2cWorker *w);
+#endif
+
+void Si5351A_bus_cost(BusCost *cost,uint32_t bus_hz);
+uint32_t Si5351A_bus_time_us(const BusCost *cost,unsigned txns,unsigned bytes);
+
+#ifndef SI5351A_MINIMAL
+bool Si5351A_plan(const Si5351A *cur,const Si5351A *tgt,const BusCost *cost,WritePlan *plan);
+bool Si5351A_plan_run(Si5351A *si,const Si5351A *tgt,const WritePlan *plan);
+bool Si5351A_transition(Si5351A *si,const Si5351A *tgt,const BusCost *cost);
+#endif
+
+#ifndef SI5351A_MINIMAL
+
+// Call trace recording (si5351a_trace.c): build the application with
+// -DSI5351A_TRACE and call Si5351A_trace_open() to log the calls below
+// for si_replay. Without an open trace the wrappers only pass through.
+
+int Si5351A_trace_open(const char *path);
+void Si5351A_trace_close(void);
+
+bool Si5351A_trace_init(Si5351A *si,uint8_t i2c_addr,i2c_readcb_t readcb,i2c_writecb_t writecb,void *arg,XtalCap cap);
+void Si5351A_trace_attach(Si5351A *si,uint8_t i2c_addr,i2c_readcb_t readcb,i2c_writecb_t writecb,void *arg);
+bool Si5351A_trace_device_reset(Si5351A *si,XtalCap cap);
+void Si5351A_trace_reset_begin(Si5351A *si,XtalCap cap);
+int Si5351A_trace_reset_step(Si5351A *si);
+bool Si5351A_trace_is_busy(Si5351A *si);
+bool Si5351A_trace_clock_enable(Si5351A *si,int clockx,bool on);
+bool Si5351A_trace_clock_enable_pin(Si5351A *si,int clockx,bool enable);
+bool Si5351A_trace_clock_power(Si5351A *si,int clockx,bool on);
+bool Si5351A_trace_clock_msynth(Si5351A *si,int clockx,MultiSynthMode mode);
+bool Si5351A_trace_clock_polarity(Si5351A *si,int clockx,bool invert);
+bool Si5351A_trace_clock_source(Si5351A *si,int clockx,ClockSource src);
+bool Si5351A_trace_clock_pll(Si5351A *si,int clockx,int pllx);
+bool Si5351A_trace_clock_drive(Si5351A *si,int clockx,ClockDrive drv);
+bool Si5351A_trace_clock_disable_state(Si5351A *si,int clockx,DisState state);
+bool Si5351A_trace_clock_intmask(Si5351A *si,int pllx,bool mask);
+bool Si5351A_trace_xtal_cap(Si5351A *si,XtalCap cap);
+bool Si5351A_trace_pll_reset(Si5351A *si,int pllx);
+int Si5351A_trace_pll_is_reset(Si5351A *si,int pllx);
+bool Si5351A_trace_set_pll(Si5351A *si,short pllx,uint32_t A,uint32_t B,uint32_t C);
+bool Si5351A_trace_set_msynth(Si5351A *si,short msynthx,uint32_t A,uint32_t B,uint32_t C);
+bool Si5351A_trace_msynth_div(Si5351A *si,short msynth,RxDiv div);
+#ifndef SI5351A_NO_PHASE
+bool Si5351A_trace_set_phase(Si5351A *si,int clockx,unsigned phase);
+#endif
+#ifndef SI5351A_NO_SPREAD
+bool Si5351A_trace_spread(Si5351A *si,SpreadMode mode,uint32_t ppm);
+bool Si5351A_trace_spread_enable(Si5351A *si,bool on);
+#endif
+bool Si5351A_trace_is_lol(Si5351A *si,int pllx);
+void Si5351A_trace_xtal_freq(Si5351A *si,uint32_t xtal_hz);
+void Si5351A_trace_xtal_ppb(Si5351A *si,int32_t ppb);
+void Si5351A_trace_xtal_measured(Si5351A *si,uint32_t measured_hz);
+int Si5351A_trace_recalibrate(Si5351A *si);
+bool Si5351A_trace_set_frequency(Si5351A *si,int clockx,short pllx,uint32_t freq_hz);
+bool Si5351A_trace_apply_freqs(Si5351A *si,const ClockFreq cf[3],uint32_t *bus_us);
+int Si5351A_trace_fleet_init(FleetChip *chips,unsigned n,const FleetBus *buses,unsigned nbuses,uint32_t timeout_us);
+bool Si5351A_trace_commit(Si5351A *si,const RegPatch *p,unsigned n);
+bool Si5351A_trace_plan_run(Si5351A *si,const Si5351A *tgt,const WritePlan *plan);
+bool Si5351A_trace_transition(Si5351A *si,const Si5351A *tgt,const BusCost *cost);
+int Si5351A_trace_sched_poll(RetuneSched *rs,uint32_t now_us);
+int Si5351A_trace_monitor_poll(Monitor *mon,uint32_t now_us,uint8_t *diffs,unsigned maxdiffs);
+int Si5351A_trace_sweep(Si5351A *si,const Sweep *sw);
+int Si5351A_trace_verify(Si5351A *si,uint8_t *diffs,unsigned maxdiffs);
+void Si5351A_trace_intidx_use(Si5351A *si,const IntIndex *idx);
+int Si5351A_trace_shm_publish(DevShm *shm,Si5351A *si,bool poll_status);
+bool Si5351A_trace_hop_init(Hopper *hp,Si5351A *si,int clockx,uint32_t freq_hz);
+bool Si5351A_trace_hop_next(Hopper *hp,uint32_t freq_hz);
+int Si5351A_trace_hop_poll(Hopper *hp);
+bool Si5351A_trace_hop_switch(Hopper *hp);
+bool Si5351A_trace_hop(Hopper *hp,uint32_t freq_hz);
+bool Si5351A_trace_commit_async(Si5351A *si,AsyncOp *op,const RegPatch *p,unsigned n,async_donecb_t *done,void *ctx);
+bool Si5351A_trace_set_frequency_async(Si5351A *si,AsyncOp *op,int clockx,short pllx,uint32_t freq_hz,async_donecb_t *done,void *ctx);
+
+#if defined(SI5351A_TRACE) && !defined(SI5351A_TRACE_IMPL)
+#define Si5351A_init			Si5351A_trace_init
+#define Si5351A_attach			Si5351A_trace_attach
+#define Si5351A_device_reset		Si5351A_trace_device_reset
+#define Si5351A_reset_begin		Si5351A_trace_reset_begin
+#define Si5351A_reset_step		Si5351A_trace_reset_step
+#define Si5351A_is_busy			Si5351A_trace_is_busy
+#define Si5351A_clock_enable		Si5351A_trace_clock_enable
+#define Si5351A_clock_enable_pin	Si5351A_trace_clock_enable_pin
+#define Si5351A_clock_power		Si5351A_trace_clock_power
+#define Si5351A_clock_msynth		Si5351A_trace_clock_msynth
+#define Si5351A_clock_polarity		Si5351A_trace_clock_polarity
+#define Si5351A_clock_source		Si5351A_trace_clock_source
+#define Si5351A_clock_pll		Si5351A_trace_clock_pll
+#define Si5351A_clock_drive		Si5351A_trace_clock_drive
+#define Si5351A_clock_disable_state	Si5351A_trace_clock_disable_state
+#define Si5351A_clock_intmask		Si5351A_trace_clock_intmask
+#define Si5351A_xtal_cap		Si5351A_trace_xtal_cap
+#define Si5351A_pll_reset		Si5351A_trace_pll_reset
+#define Si5351A_pll_is_reset		Si5351A_trace_pll_is_reset
+#define Si5351A_set_pll			Si5351A_trace_set_pll
+#define Si5351A_set_msynth		Si5351A_trace_set_msynth
+#define Si5351A_msynth_div		Si5351A_trace_msynth_div
+#define Si5351A_set_phase		Si5351A_trace_set_phase
+#define Si5351A_spread			Si5351A_trace_spread
+#define Si5351A_spread_enable		Si5351A_trace_spread_enable
+#define Si5351A_is_lol			Si5351A_trace_is_lol
+#define Si5351A_xtal_freq		Si5351A_trace_xtal_freq
+#define Si5351A_xtal_ppb		Si5351A_trace_xtal_ppb
+#define Si5351A_xtal_measured		Si5351A_trace_xtal_measured
+#define Si5351A_recalibrate		Si5351A_trace_recalibrate
+#define Si5351A_set_frequency		Si5351A_trace_set_frequency
+#define Si5351A_apply_freqs		Si5351A_trace_apply_freqs
+#define Si5351A_fleet_init		Si5351A_trace_fleet_init
+#define Si5351A_commit			Si5351A_trace_commit
+#define Si5351A_plan_run		Si5351A_trace_plan_run
+#define Si5351A_transition		Si5351A_trace_transition
+#define Si5351A_sched_poll		Si5351A_trace_sched_poll
+#define Si5351A_monitor_poll		Si5351A_trace_monitor_poll
+#define Si5351A_sweep			Si5351A_trace_sweep
+#define Si5351A_verify			Si5351A_trace_verify
+#define Si5351A_intidx_use		Si5351A_trace_intidx_use
+#define Si5351A_shm_publish		Si5351A_trace_shm_publish
+#define Si5351A_hop_init		Si5351A_trace_hop_init
+#define Si5351A_hop_next		Si5351A_trace_hop_next
+#define Si5351A_hop_poll		Si5351A_trace_hop_poll
+#define Si5351A_hop_switch		Si5351A_trace_hop_switch
+#define Si5351A_hop			Si5351A_trace_hop
+#define Si5351A_commit_async		Si5351A_trace_commit_async
+#define Si5351A_set_frequency_async	Si5351A_trace_set_frequency_async
+#endif
+
+#endif // SI5351A_MINIMAL
+
 #ifdef __cplusplus
 }
 #endif
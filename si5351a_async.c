@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////
+// si5351a_async.c -- Worker thread async backend for the Si5351A
+// Date: Mon Oct 19 14:02:17 2026   (C) ve3wwg@gmail.com
+//
+// Turns a synchronous i2c_writecb_t into an i2c_submitcb_t: transfers
+// are queued and performed back to back by a worker thread, which
+// also calls the completion callbacks. Use it with
+//
+//	Si5351A_init(&si,addr,readcb,writecb,arg,cap);
+//	Si5351A_async_backend(&si,Si5351A_worker_submit,worker);
+///////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "si5351a.h"
+
+struct s_xfer {
+	uint8_t		i2c_addr;
+	uint8_t		*buf;
+	uint8_t		bytes;
+	i2c_donecb_t	*done;
+	void		*ctx;
+};
+
+struct s_I2cWorker {
+	i2c_writecb_t	*writecb;
+	pthread_t	thread;
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	bool		stop;
+	unsigned	depth;		// Queue capacity
+	unsigned	head, count;
+	struct s_xfer	q[];		// Ring buffer
+};
+
+static void *
+worker_main(void *arg) {
+	I2cWorker *w = (I2cWorker *)arg;
+	struct s_xfer xf;
+	int rc;
+
+	pthread_mutex_lock(&w->mutex);
+	for (;;) {
+		while ( !w->count && !w->stop )
+			pthread_cond_wait(&w->cond,&w->mutex);
+		if ( !w->count )
+			break;				// Stopped and drained
+		xf = w->q[w->head];
+		w->head = (w->head + 1) % w->depth;
+		--w->count;
+		pthread_mutex_unlock(&w->mutex);
+
+		rc = w->writecb(xf.i2c_addr,xf.buf,xf.bytes);
+		xf.done(xf.ctx,rc);
+
+		pthread_mutex_lock(&w->mutex);
+	}
+	pthread_mutex_unlock(&w->mutex);
+	return 0;
+}
+
+I2cWorker *
+Si5351A_worker_start(i2c_writecb_t *writecb,unsigned depth) {
+	I2cWorker *w;
+
+	if ( !depth )
+		depth = 16;
+	if ( !(w = calloc(1,sizeof *w + depth * sizeof w->q[0])) )
+		return 0;
+	w->writecb = writecb;
+	w->depth = depth;
+	pthread_mutex_init(&w->mutex,0);
+	pthread_cond_init(&w->cond,0);
+	if ( pthread_create(&w->thread,0,worker_main,w) ) {
+		pthread_cond_destroy(&w->cond);
+		pthread_mutex_destroy(&w->mutex);
+		free(w);
+		return 0;
+	}
+	return w;
+}
+
+//////////////////////////////////////////////////////////////////////
+// i2c_submitcb_t: queue a write. Returns -1 if the queue is full or
+// the worker is stopping.
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_worker_submit(void *arg,uint8_t i2c_addr,uint8_t *buf,uint8_t bytes,i2c_donecb_t *done,void *ctx) {
+	I2cWorker *w = (I2cWorker *)arg;
+	struct s_xfer *xp;
+	int rc = -1;
+
+	pthread_mutex_lock(&w->mutex);
+	if ( !w->stop && w->count < w->depth ) {
+		xp = &w->q[(w->head + w->count++) % w->depth];
+		xp->i2c_addr = i2c_addr;
+		xp->buf = buf;
+		xp->bytes = bytes;
+		xp->done = done;
+		xp->ctx = ctx;
+		pthread_cond_signal(&w->cond);
+		rc = 0;
+	}
+	pthread_mutex_unlock(&w->mutex);
+	return rc;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Complete queued transfers, then stop and free the worker.
+//////////////////////////////////////////////////////////////////////
+
+void
+Si5351A_worker_stop(I2cWorker *w) {
+
+	pthread_mutex_lock(&w->mutex);
+	w->stop = true;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->mutex);
+	pthread_join(w->thread,0);
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->mutex);
+	free(w);
+}
+
+// End si5351a_async.c
@@ -0,0 +1,142 @@
+//////////////////////////////////////////////////////////////////////
+// si5351a_co.hpp -- C++20 coroutine wrapper for the Si5351A library
+// Date: Mon Oct 19 14:40:05 2026   (C) ve3wwg@gmail.com
+//
+// Requires an async backend (Si5351A_async_backend). Example:
+//
+//	si5351a::Task hop(si5351a::Device &dev) {
+//		bool ok = co_await dev.set_frequency(0,0,7100000);
+//		...
+//	}
+//
+// The coroutine resumes in the context that completes the transfer
+// (worker thread, interrupt handler or event loop). Only one
+// operation may be outstanding per Device.
+///////////////////////////////////////////////////////////////////////
+
+#ifndef SI5351A_CO_HPP
+#define SI5351A_CO_HPP
+
+#include <coroutine>
+#include <exception>
+
+#include "si5351a.h"
+
+namespace si5351a {
+
+//////////////////////////////////////////////////////////////////////
+// Fire and forget coroutine return type
+//////////////////////////////////////////////////////////////////////
+
+struct Task {
+	struct promise_type {
+		Task get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+//////////////////////////////////////////////////////////////////////
+// Awaitable for one asynchronous commit; co_await yields true when
+// every burst was written. A Failed commit completes at once with
+// false (e.g. parameters that could not be encoded).
+//////////////////////////////////////////////////////////////////////
+
+class Commit {
+public:
+	enum Kind { Patches, Frequency, Failed };
+
+	Commit(Si5351A &si,const RegPatch *p,unsigned n) : si_(si), kind_(Patches), n_(n) {
+		for ( unsigned x=0; x < n && x < SI5351A_ASYNC_PATCHES; ++x )
+			p_[x] = p[x];
+	}
+	Commit(Si5351A &si,int clockx,short pllx,uint32_t freq_hz)
+		: si_(si), kind_(Frequency), clockx_(clockx), pllx_(pllx), freq_hz_(freq_hz) {}
+	Commit(Si5351A &si,Kind kind) : si_(si), kind_(kind) {}
+
+	Commit(const Commit &) = delete;
+	Commit &operator=(const Commit &) = delete;
+
+	bool await_ready() const noexcept { return kind_ == Failed; }
+
+	bool await_suspend(std::coroutine_handle<> h) noexcept {
+		bool started;
+
+		h_ = h;
+		if ( kind_ == Frequency )
+			started = Si5351A_set_frequency_async(&si_,&op_,clockx_,pllx_,freq_hz_,done,this);
+		else	started = Si5351A_commit_async(&si_,&op_,p_,n_,done,this);
+		if ( !started ) {
+			ok_ = false;
+			return false;		// Resume at once
+		}
+		return true;			// Do not touch *this: may be resumed already
+	}
+
+	bool await_resume() const noexcept { return ok_; }
+
+private:
+	static void done(void *ctx,bool ok) {
+		Commit *c = static_cast<Commit *>(ctx);
+
+		c->ok_ = ok;
+		c->h_.resume();
+	}
+
+	Si5351A			&si_;
+	Kind			kind_;
+	RegPatch		p_[SI5351A_ASYNC_PATCHES];
+	unsigned		n_ = 0;
+	int			clockx_ = 0;
+	short			pllx_ = 0;
+	uint32_t		freq_hz_ = 0;
+	AsyncOp			op_;
+	bool			ok_ = false;
+	std::coroutine_handle<>	h_;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Coroutine view of a device
+//////////////////////////////////////////////////////////////////////
+
+class Device {
+public:
+	explicit Device(Si5351A &si) : si_(si) {}
+
+	Commit set_frequency(int clockx,short pllx,uint32_t freq_hz) {
+		return Commit(si_,clockx,pllx,freq_hz);
+	}
+
+	Commit set_pll(short pllx,uint32_t A,uint32_t B,uint32_t C) {
+		RegPatch p;
+
+		if ( !Si5351A_encode_pll(pllx,A,B,C,&p) )
+			return Commit(si_,Commit::Failed);
+		return Commit(si_,&p,1);
+	}
+
+	Commit set_msynth(short msynthx,uint32_t A,uint32_t B,uint32_t C) {
+		RegPatch p;
+
+		if ( !Si5351A_encode_msynth(msynthx,A,B,C,&p) )
+			return Commit(si_,Commit::Failed);
+		return Commit(si_,&p,1);
+	}
+
+	Commit commit(const RegPatch *p,unsigned n) {
+		return Commit(si_,p,n);
+	}
+
+	Si5351A &raw() { return si_; }
+
+private:
+	Si5351A		&si_;
+};
+
+} // namespace si5351a
+
+#endif // SI5351A_CO_HPP
+
+// End si5351a_co.hpp
@@ -0,0 +1,154 @@
+//////////////////////////////////////////////////////////////////////
+// si5351a_fleet.c -- Concurrent bring-up of many Si5351A chips
+// Date: Mon Oct 19 21:14:52 2026   (C) ve3wwg@gmail.com
+//
+// One thread per bus. On a bus, the chips' reset state machines
+// (Si5351A_reset_step) are run round robin: while one chip is in
+// SYS_INIT or PLL reset, the others get the bus. Each chip records
+// when it started and finished and, on failure, the I/O status.
+///////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "si5351a.h"
+
+typedef struct {
+	FleetChip	*chips;
+	unsigned	n;
+	unsigned	busx;
+	const FleetBus	*bus;
+	uint64_t	t0_us;		// Fleet start
+	uint32_t	timeout_us;
+	pthread_t	thread;
+} BusWork;
+
+static uint64_t
+now_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+static void
+chip_done(FleetChip *cp,bool ok,uint64_t t0_us) {
+
+	cp->ok = ok;
+	cp->ready_us = (uint32_t)(now_us() - t0_us);
+	cp->txns = cp->si->txns;
+	cp->status = cp->si->status;
+}
+
+static void *
+bus_main(void *arg) {
+	BusWork *bw = (BusWork *)arg;
+	unsigned pending = 0;
+
+	for ( unsigned x=0; x < bw->n; ++x ) {
+		FleetChip *cp = &bw->chips[x];
+
+		if ( cp->bus != bw->busx )
+			continue;
+		Si5351A_attach(cp->si,cp->i2c_addr,bw->bus->readcb,bw->bus->writecb,bw->bus->arg);
+		Si5351A_reset_begin(cp->si,cp->cap);
+		cp->ok = false;
+		cp->start_us = cp->ready_us = 0;
+		++pending;
+	}
+
+	while ( pending > 0 ) {
+		for ( unsigned x=0; x < bw->n && pending > 0; ++x ) {
+			FleetChip *cp = &bw->chips[x];
+			Si5351A *si = cp->si;
+			int rc;
+
+			if ( cp->bus != bw->busx || si->reset_state >= ResetDone )
+				continue;
+			if ( si->reset_state == ResetBusy && !si->txns )
+				cp->start_us = (uint32_t)(now_us() - bw->t0_us);
+			if ( (rc = Si5351A_reset_step(si)) > 0 ) {
+				if ( bw->timeout_us && now_us() - bw->t0_us > bw->timeout_us ) {
+					si->reset_state = ResetFailed;
+					si->status.err = ErrTimeout;
+					chip_done(cp,false,bw->t0_us);
+					--pending;
+				}
+				continue;		// Waiting: next chip
+			}
+			chip_done(cp,rc == 0,bw->t0_us);
+			--pending;
+		}
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Fail a chip whose bus thread was never started
+//////////////////////////////////////////////////////////////////////
+
+static void
+chip_unstarted(FleetChip *cp,const FleetBus *bus) {
+
+	Si5351A_attach(cp->si,cp->i2c_addr,bus->readcb,bus->writecb,bus->arg);
+	cp->si->reset_state = ResetFailed;
+	cp->si->status.err = ErrIO;
+	cp->ok = false;
+	cp->start_us = cp->ready_us = 0;
+	cp->txns = 0;
+	cp->status = cp->si->status;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Initialize n chips spread over nbuses buses (chips[].si, bus,
+// i2c_addr and cap set by the caller). A chip still waiting after
+// timeout_us (0 = no limit) fails with ErrTimeout. Returns the number
+// of chips that failed, or -1 if the bus threads could not be started
+// (the chips of buses left unstarted fail with ErrIO).
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_fleet_init(FleetChip *chips,unsigned n,const FleetBus *buses,unsigned nbuses,uint32_t timeout_us) {
+	BusWork *work;
+	unsigned started = 0;
+	uint64_t t0_us;
+	int failed = 0;
+
+	for ( unsigned x=0; x<n; ++x )
+		if ( chips[x].bus >= nbuses )
+			return -1;
+	if ( !nbuses || !(work = calloc(nbuses,sizeof *work)) )
+		return -1;
+
+	t0_us = now_us();
+	for ( ; started < nbuses; ++started ) {
+		BusWork *bw = &work[started];
+
+		bw->chips = chips;
+		bw->n = n;
+		bw->busx = started;
+		bw->bus = &buses[started];
+		bw->t0_us = t0_us;
+		bw->timeout_us = timeout_us;
+		if ( pthread_create(&bw->thread,0,bus_main,bw) )
+			break;
+	}
+	for ( unsigned x=0; x<started; ++x )
+		pthread_join(work[x].thread,0);
+	free(work);
+	if ( started < nbuses ) {
+		for ( unsigned x=0; x<n; ++x )
+			if ( chips[x].bus >= started )
+				chip_unstarted(&chips[x],&buses[chips[x].bus]);
+		return -1;
+	}
+
+	for ( unsigned x=0; x<n; ++x )
+		if ( !chips[x].ok )
+			++failed;
+	return failed;
+}
+
+// End si5351a_fleet.c
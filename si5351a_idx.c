@@ -0,0 +1,179 @@
+//////////////////////////////////////////////////////////////////////
+// si5351a_idx.c -- Integer mode frequency index for the Si5351A
+// Date: Mon Oct 19 10:12:41 2026   (C) ve3wwg@gmail.com
+//
+// Builds the sorted table of every output frequency reachable with
+// an integer PLL ratio and an even integer MultiSynth divider, and
+// saves it to or maps it from a file:
+//
+//	IntIndexHdr, followed by count IntEntry (host byte order)
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "si5351a.h"
+
+#define VCO_MIN		600000000u
+#define VCO_MAX		900000000u
+#define PLL_A_MIN	15
+#define PLL_A_MAX	90
+#define MS_MIN		6		// 4 needs MSx_DIVBY4
+#define MS_MAX		2048
+#define ENT_INEXACT	0x80		// In rdiv while building: not a whole Hz
+
+static int
+cmp_entry(const void *a,const void *b) {
+	const IntEntry *ea = (const IntEntry *)a, *eb = (const IntEntry *)b;
+
+	if ( ea->freq_q4 != eb->freq_q4 )
+		return ea->freq_q4 < eb->freq_q4 ? -1 : 1;
+	if ( (ea->rdiv ^ eb->rdiv) & ENT_INEXACT )	// Prefer exact Hz
+		return ea->rdiv & ENT_INEXACT ? 1 : -1;
+	if ( ea->rdiv != eb->rdiv )			// Then smallest R
+		return ea->rdiv < eb->rdiv ? -1 : 1;
+	return ea->pll_a > eb->pll_a ? -1 : ea->pll_a < eb->pll_a;	// Then highest VCO
+}
+
+//////////////////////////////////////////////////////////////////////
+// Build the index for xtal_hz. Frequencies that round to the same
+// 1/16 Hz keep only one entry, an exact whole Hz one if there is one.
+// Returns the entry count or -1.
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_intidx_build(IntIndex *idx,uint32_t xtal_hz) {
+	uint32_t amin, amax, n = 0, u = 0;
+	IntEntry *ents, *shrunk;
+
+	memset(idx,0,sizeof *idx);
+	if ( !xtal_hz )
+		return -1;
+
+	amin = (VCO_MIN + xtal_hz - 1) / xtal_hz;
+	amax = VCO_MAX / xtal_hz;
+	if ( amin < PLL_A_MIN )
+		amin = PLL_A_MIN;
+	if ( amax > PLL_A_MAX )
+		amax = PLL_A_MAX;
+	if ( amin > amax )
+		return -1;
+
+	ents = malloc(sizeof *ents * (amax - amin + 1) * ((MS_MAX - MS_MIN) / 2 + 1) * 8);
+	if ( !ents )
+		return -1;
+
+	for ( uint32_t a=amin; a<=amax; ++a ) {
+		uint64_t vco_q4 = (uint64_t)xtal_hz * a << 4;
+
+		for ( uint32_t ms=MS_MIN; ms<=MS_MAX; ms += 2 ) {
+			for ( unsigned r=0; r<8; ++r ) {
+				uint64_t div = (uint64_t)ms << r;
+				uint64_t fq = (vco_q4 + div / 2) / div;
+
+				if ( fq < ((uint64_t)SI5351A_FREQ_MIN << 4) || fq > ((uint64_t)SI5351A_FREQ_MAX << 4) )
+					continue;
+				ents[n].freq_q4 = (uint32_t)fq;
+				ents[n].ms = ms;
+				ents[n].pll_a = a;
+				ents[n].rdiv = r;
+				if ( (uint64_t)xtal_hz * a % div )
+					ents[n].rdiv |= ENT_INEXACT;
+				++n;
+			}
+		}
+	}
+
+	qsort(ents,n,sizeof *ents,cmp_entry);
+	for ( uint32_t x=0; x<n; ++x )
+		if ( !u || ents[x].freq_q4 != ents[u-1].freq_q4 ) {
+			ents[u] = ents[x];
+			ents[u++].rdiv &= ~ENT_INEXACT;
+		}
+
+	if ( (shrunk = realloc(ents,sizeof *ents * (u ? u : 1))) != 0 )
+		ents = shrunk;
+
+	idx->xtal_hz = xtal_hz;
+	idx->count = u;
+	idx->entries = ents;
+	idx->mem = ents;
+	return u;
+}
+
+int
+Si5351A_intidx_save(const IntIndex *idx,const char *path) {
+	IntIndexHdr hdr;
+	FILE *f = fopen(path,"wb");
+	int rc = 0;
+
+	if ( !f )
+		return -1;
+	memset(&hdr,0,sizeof hdr);
+	hdr.magic = SI5351A_IDX_MAGIC;
+	hdr.xtal_hz = idx->xtal_hz;
+	hdr.count = idx->count;
+	if ( fwrite(&hdr,sizeof hdr,1,f) != 1
+	  || fwrite(idx->entries,sizeof *idx->entries,idx->count,f) != idx->count )
+		rc = -1;
+	if ( fclose(f) )
+		rc = -1;
+	return rc;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Map a saved index read-only. Returns the entry count or -1.
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_intidx_map(IntIndex *idx,const char *path) {
+	const IntIndexHdr *hdr;
+	struct stat st;
+	void *mem;
+	int fd;
+
+	memset(idx,0,sizeof *idx);
+	if ( (fd = open(path,O_RDONLY)) < 0 )
+		return -1;
+	if ( fstat(fd,&st) < 0 || (size_t)st.st_size < sizeof *hdr ) {
+		close(fd);
+		return -1;
+	}
+	mem = mmap(0,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if ( mem == MAP_FAILED )
+		return -1;
+
+	hdr = (const IntIndexHdr *)mem;
+	if ( hdr->magic != SI5351A_IDX_MAGIC
+	  || (size_t)st.st_size < sizeof *hdr + (size_t)hdr->count * sizeof(IntEntry) ) {
+		munmap(mem,st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	idx->xtal_hz = hdr->xtal_hz;
+	idx->count = hdr->count;
+	idx->entries = (const IntEntry *)(hdr + 1);
+	idx->mem = mem;
+	idx->memlen = st.st_size;
+	return idx->count;
+}
+
+void
+Si5351A_intidx_free(IntIndex *idx) {
+
+	if ( idx->memlen )
+		munmap(idx->mem,idx->memlen);
+	else	free(idx->mem);
+	memset(idx,0,sizeof *idx);
+}
+
+// End si5351a_idx.c
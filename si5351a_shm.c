@@ -0,0 +1,184 @@
+//////////////////////////////////////////////////////////////////////
+// si5351a_shm.c -- Shared memory publication of Si5351A state
+// Date: Mon Oct 19 16:25:48 2026   (C) ve3wwg@gmail.com
+//
+// The process owning the device publishes a DevSnapshot into a POSIX
+// shared memory segment under a seqlock; any number of reader
+// processes copy it out without locks and without I2C traffic:
+//
+//	owner:	shm = Si5351A_shm_create("/si5351a");
+//		... Si5351A_shm_publish(shm,&si,true) after changes/periodically
+//	reader:	shm = Si5351A_shm_open("/si5351a");
+//		Si5351A_shm_read(shm,&snap);
+//
+// The sequence count is odd while an update is in progress; readers
+// retry until they copy a snapshot with the same even count before
+// and after.
+///////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "si5351a.h"
+
+#define SHM_READ_TRIES	1000		// Give up (writer stalled mid update)
+
+struct s_ShmSeg {			// Shared memory layout
+	uint32_t	magic;		// SI5351A_SHM_MAGIC
+	uint32_t	size;		// sizeof(struct s_ShmSeg)
+	_Atomic uint32_t seq;		// Seqlock count (odd = updating)
+	DevSnapshot	snap;
+};
+
+struct s_DevShm {
+	struct s_ShmSeg	*seg;
+	bool		owner;
+	char		name[64];
+};
+
+static DevShm *
+shm_map(const char *name,bool owner) {
+	int prot = owner ? PROT_READ|PROT_WRITE : PROT_READ;
+	DevShm *shm;
+	struct stat st;
+	int fd;
+
+	if ( strlen(name) >= sizeof shm->name || !(shm = calloc(1,sizeof *shm)) )
+		return 0;
+	strcpy(shm->name,name);
+	shm->owner = owner;
+
+	fd = owner ? shm_open(name,O_RDWR|O_CREAT,0644) : shm_open(name,O_RDONLY,0);
+	if ( fd < 0 )
+		goto fail;
+	if ( owner && ftruncate(fd,sizeof *shm->seg) < 0 )
+		goto fail_fd;
+	if ( fstat(fd,&st) < 0 || st.st_size < (off_t)sizeof *shm->seg )
+		goto fail_fd;
+	shm->seg = mmap(0,sizeof *shm->seg,prot,MAP_SHARED,fd,0);
+	close(fd);
+	if ( shm->seg == MAP_FAILED )
+		goto fail;
+	if ( !owner && (shm->seg->magic != SI5351A_SHM_MAGIC || shm->seg->size != sizeof *shm->seg) ) {
+		munmap(shm->seg,sizeof *shm->seg);
+		goto fail;
+	}
+	return shm;
+
+fail_fd:
+	close(fd);
+fail:
+	free(shm);
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Create (or take over) the segment; owner process only.
+//////////////////////////////////////////////////////////////////////
+
+DevShm *
+Si5351A_shm_create(const char *name) {
+	DevShm *shm = shm_map(name,true);
+
+	if ( shm ) {
+		atomic_store_explicit(&shm->seg->seq,0,memory_order_relaxed);
+		memset(&shm->seg->snap,0,sizeof shm->seg->snap);
+		shm->seg->size = sizeof *shm->seg;
+		atomic_thread_fence(memory_order_release);
+		shm->seg->magic = SI5351A_SHM_MAGIC;
+	}
+	return shm;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Publish the shadow and its decoding. With poll_status, r0 is read
+// once (one I2C transaction) for the LOL and SYS_INIT bits; else the
+// last published status is kept. Returns -1 if the status read
+// failed (the rest is published anyway).
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_shm_publish(DevShm *shm,Si5351A *si,bool poll_status) {
+	struct s_ShmSeg *seg = shm->seg;
+	DevSnapshot snap;
+	uint32_t seq;
+	int rc = 0;
+
+	// Build outside the write window, to keep it short:
+	snap = seg->snap;
+	if ( poll_status ) {
+		bool lol_a = Si5351A_is_lol(si,0);
+
+		if ( si->status.err != ErrNone )
+			rc = -1;
+		else	{
+			snap.lol[0] = lol_a;
+			snap.lol[1] = si->r0.lol_b;
+			snap.sys_init = si->r0.sys_init;
+		}
+	}
+	Si5351A_image(si,snap.regs,snap.known);
+	snap.xtal_hz = si->xtal_hz;
+	snap.xtal_ppb = si->xtal_ppb;
+	memcpy(snap.freq_hz,si->freq_hz,sizeof snap.freq_hz);
+	Si5351A_decode(si,si->xtal_hz,si->xtal_ppb,&snap.dec);
+	++snap.version;
+
+	seq = atomic_load_explicit(&seg->seq,memory_order_relaxed);
+	atomic_store_explicit(&seg->seq,seq+1,memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	seg->snap = snap;
+	atomic_store_explicit(&seg->seq,seq+2,memory_order_release);
+	return rc;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Attach read only (reader processes).
+//////////////////////////////////////////////////////////////////////
+
+DevShm *
+Si5351A_shm_open(const char *name) {
+
+	return shm_map(name,false);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Copy a consistent snapshot. Never blocks on the owner; returns
+// false only if every try overlapped an update, or nothing has been
+// published yet.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_shm_read(const DevShm *shm,DevSnapshot *snap) {
+	struct s_ShmSeg *seg = shm->seg;
+	uint32_t s1, s2;
+
+	for ( unsigned tries=0; tries < SHM_READ_TRIES; ++tries ) {
+		s1 = atomic_load_explicit(&seg->seq,memory_order_acquire);
+		if ( s1 & 1 )
+			continue;
+		memcpy(snap,&seg->snap,sizeof *snap);
+		atomic_thread_fence(memory_order_acquire);
+		s2 = atomic_load_explicit(&seg->seq,memory_order_relaxed);
+		if ( s1 == s2 )
+			return s1 != 0;
+	}
+	return false;
+}
+
+void
+Si5351A_shm_close(DevShm *shm,bool unlink) {
+
+	munmap(shm->seg,sizeof *shm->seg);
+	if ( unlink && shm->owner )
+		shm_unlink(shm->name);
+	free(shm);
+}
+
+// End si5351a_shm.c
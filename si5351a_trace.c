@@ -0,0 +1,494 @@
+//////////////////////////////////////////////////////////////////////
+// si5351a_trace.c -- Si5351A API call recorder
+// Date: Mon Oct 19 19:05:33 2026   (C) ve3wwg@gmail.com
+//
+// Applications built with -DSI5351A_TRACE call these wrappers in
+// place of the API (see si5351a.h). Each call is logged as one line:
+//
+//	<device> <call> <arguments...>
+//
+// where device numbers devices in order of first use. si_replay runs
+// a log against an in-memory Si5351A to measure bus traffic. Calls on
+// devices beyond TRACE_DEVS are not logged; the first such call
+// writes the line "! overflow", which makes the replay fail. So does
+// "! untraced <call>", written for calls whose effect on the bus
+// cannot be recorded (Si5351A_plan_run, Si5351A_transition).
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#define SI5351A_TRACE_IMPL
+#include "si5351a.h"
+
+#define TRACE_DEVS	128		// Must match si_replay MAX_DEVS
+
+static FILE *tracef = 0;
+static const Si5351A *devs[TRACE_DEVS];
+static unsigned ndevs = 0;
+static bool overflow = false;
+
+int
+Si5351A_trace_open(const char *path) {
+
+	Si5351A_trace_close();
+	if ( !(tracef = fopen(path,"w")) )
+		return -1;
+	fprintf(tracef,"# si5351a trace 1\n");
+	return 0;
+}
+
+void
+Si5351A_trace_close(void) {
+
+	if ( tracef )
+		fclose(tracef);
+	tracef = 0;
+	ndevs = 0;
+	overflow = false;
+}
+
+static void
+trace(const Si5351A *si,const char *call,const char *format,...) {
+	va_list ap;
+	unsigned devx;
+
+	if ( !tracef )
+		return;
+	for ( devx=0; devx < ndevs && devs[devx] != si; ++devx )
+		;
+	if ( devx == ndevs ) {
+		if ( ndevs >= TRACE_DEVS ) {
+			if ( !overflow )
+				fprintf(tracef,"! overflow %s\n",call);
+			overflow = true;
+			return;
+		}
+		devs[ndevs++] = si;
+	}
+	fprintf(tracef,"%u %s",devx,call);
+	va_start(ap,format);
+	vfprintf(tracef,format,ap);
+	va_end(ap);
+	fputc('\n',tracef);
+}
+
+static void
+untraced(const char *call) {
+
+	if ( tracef )
+		fprintf(tracef,"! untraced %s\n",call);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Patches are logged one per line ahead of the call that takes them:
+//
+//	<device> patch <reg> <len> <data...> <mask...>
+//////////////////////////////////////////////////////////////////////
+
+static void
+trace_patches(const Si5351A *si,const RegPatch *p,unsigned n) {
+	char args[2*SI5351A_PATCH_MAX*4+16];
+
+	for ( unsigned x=0; x<n; ++x ) {
+		unsigned len = p[x].len <= SI5351A_PATCH_MAX ? p[x].len : SI5351A_PATCH_MAX;
+		int pos = snprintf(args,sizeof args," %u %u",p[x].reg,p[x].len);
+
+		for ( unsigned y=0; y<len; ++y )
+			pos += snprintf(args+pos,sizeof args-pos," %u",p[x].data[y]);
+		for ( unsigned y=0; y<len; ++y )
+			pos += snprintf(args+pos,sizeof args-pos," %u",p[x].mask[y]);
+		trace(si,"patch","%s",args);
+	}
+}
+
+bool
+Si5351A_trace_init(Si5351A *si,uint8_t i2c_addr,i2c_readcb_t readcb,i2c_writecb_t writecb,void *arg,XtalCap cap) {
+
+	trace(si,"init"," %u %d",i2c_addr,(int)cap);
+	return Si5351A_init(si,i2c_addr,readcb,writecb,arg,cap);
+}
+
+void
+Si5351A_trace_attach(Si5351A *si,uint8_t i2c_addr,i2c_readcb_t readcb,i2c_writecb_t writecb,void *arg) {
+
+	trace(si,"attach"," %u",i2c_addr);
+	Si5351A_attach(si,i2c_addr,readcb,writecb,arg);
+}
+
+bool
+Si5351A_trace_device_reset(Si5351A *si,XtalCap cap) {
+
+	trace(si,"device_reset"," %d",(int)cap);
+	return Si5351A_device_reset(si,cap);
+}
+
+void
+Si5351A_trace_reset_begin(Si5351A *si,XtalCap cap) {
+
+	trace(si,"reset_begin"," %d",(int)cap);
+	Si5351A_reset_begin(si,cap);
+}
+
+int
+Si5351A_trace_reset_step(Si5351A *si) {
+
+	trace(si,"reset_step","");
+	return Si5351A_reset_step(si);
+}
+
+bool
+Si5351A_trace_is_busy(Si5351A *si) {
+
+	trace(si,"is_busy","");
+	return Si5351A_is_busy(si);
+}
+
+bool
+Si5351A_trace_clock_enable(Si5351A *si,int clockx,bool on) {
+
+	trace(si,"clock_enable"," %d %d",clockx,on);
+	return Si5351A_clock_enable(si,clockx,on);
+}
+
+bool
+Si5351A_trace_clock_enable_pin(Si5351A *si,int clockx,bool enable) {
+
+	trace(si,"clock_enable_pin"," %d %d",clockx,enable);
+	return Si5351A_clock_enable_pin(si,clockx,enable);
+}
+
+bool
+Si5351A_trace_clock_power(Si5351A *si,int clockx,bool on) {
+
+	trace(si,"clock_power"," %d %d",clockx,on);
+	return Si5351A_clock_power(si,clockx,on);
+}
+
+bool
+Si5351A_trace_clock_msynth(Si5351A *si,int clockx,MultiSynthMode mode) {
+
+	trace(si,"clock_msynth"," %d %d",clockx,(int)mode);
+	return Si5351A_clock_msynth(si,clockx,mode);
+}
+
+bool
+Si5351A_trace_clock_polarity(Si5351A *si,int clockx,bool invert) {
+
+	trace(si,"clock_polarity"," %d %d",clockx,invert);
+	return Si5351A_clock_polarity(si,clockx,invert);
+}
+
+bool
+Si5351A_trace_clock_source(Si5351A *si,int clockx,ClockSource src) {
+
+	trace(si,"clock_source"," %d %d",clockx,(int)src);
+	return Si5351A_clock_source(si,clockx,src);
+}
+
+bool
+Si5351A_trace_clock_pll(Si5351A *si,int clockx,int pllx) {
+
+	trace(si,"clock_pll"," %d %d",clockx,pllx);
+	return Si5351A_clock_pll(si,clockx,pllx);
+}
+
+bool
+Si5351A_trace_clock_drive(Si5351A *si,int clockx,ClockDrive drv) {
+
+	trace(si,"clock_drive"," %d %d",clockx,(int)drv);
+	return Si5351A_clock_drive(si,clockx,drv);
+}
+
+bool
+Si5351A_trace_clock_disable_state(Si5351A *si,int clockx,DisState state) {
+
+	trace(si,"clock_disable_state"," %d %d",clockx,(int)state);
+	return Si5351A_clock_disable_state(si,clockx,state);
+}
+
+bool
+Si5351A_trace_clock_intmask(Si5351A *si,int pllx,bool mask) {
+
+	trace(si,"clock_intmask"," %d %d",pllx,mask);
+	return Si5351A_clock_intmask(si,pllx,mask);
+}
+
+bool
+Si5351A_trace_xtal_cap(Si5351A *si,XtalCap cap) {
+
+	trace(si,"xtal_cap"," %d",(int)cap);
+	return Si5351A_xtal_cap(si,cap);
+}
+
+bool
+Si5351A_trace_pll_reset(Si5351A *si,int pllx) {
+
+	trace(si,"pll_reset"," %d",pllx);
+	return Si5351A_pll_reset(si,pllx);
+}
+
+int
+Si5351A_trace_pll_is_reset(Si5351A *si,int pllx) {
+
+	trace(si,"pll_is_reset"," %d",pllx);
+	return Si5351A_pll_is_reset(si,pllx);
+}
+
+bool
+Si5351A_trace_set_pll(Si5351A *si,short pllx,uint32_t A,uint32_t B,uint32_t C) {
+
+	trace(si,"set_pll"," %d %u %u %u",pllx,(unsigned)A,(unsigned)B,(unsigned)C);
+	return Si5351A_set_pll(si,pllx,A,B,C);
+}
+
+bool
+Si5351A_trace_set_msynth(Si5351A *si,short msynthx,uint32_t A,uint32_t B,uint32_t C) {
+
+	trace(si,"set_msynth"," %d %u %u %u",msynthx,(unsigned)A,(unsigned)B,(unsigned)C);
+	return Si5351A_set_msynth(si,msynthx,A,B,C);
+}
+
+bool
+Si5351A_trace_msynth_div(Si5351A *si,short msynth,RxDiv div) {
+
+	trace(si,"msynth_div"," %d %d",msynth,(int)div);
+	return Si5351A_msynth_div(si,msynth,div);
+}
+
+#ifndef SI5351A_NO_PHASE
+bool
+Si5351A_trace_set_phase(Si5351A *si,int clockx,unsigned phase) {
+
+	trace(si,"set_phase"," %d %u",clockx,phase);
+	return Si5351A_set_phase(si,clockx,phase);
+}
+#endif
+
+#ifndef SI5351A_NO_SPREAD
+bool
+Si5351A_trace_spread(Si5351A *si,SpreadMode mode,uint32_t ppm) {
+
+	trace(si,"spread"," %d %u",(int)mode,(unsigned)ppm);
+	return Si5351A_spread(si,mode,ppm);
+}
+
+bool
+Si5351A_trace_spread_enable(Si5351A *si,bool on) {
+
+	trace(si,"spread_enable"," %d",on);
+	return Si5351A_spread_enable(si,on);
+}
+#endif
+
+bool
+Si5351A_trace_is_lol(Si5351A *si,int pllx) {
+
+	trace(si,"is_lol"," %d",pllx);
+	return Si5351A_is_lol(si,pllx);
+}
+
+void
+Si5351A_trace_xtal_freq(Si5351A *si,uint32_t xtal_hz) {
+
+	trace(si,"xtal_freq"," %u",(unsigned)xtal_hz);
+	Si5351A_xtal_freq(si,xtal_hz);
+}
+
+void
+Si5351A_trace_xtal_ppb(Si5351A *si,int32_t ppb) {
+
+	trace(si,"xtal_ppb"," %d",(int)ppb);
+	Si5351A_xtal_ppb(si,ppb);
+}
+
+void
+Si5351A_trace_xtal_measured(Si5351A *si,uint32_t measured_hz) {
+
+	trace(si,"xtal_measured"," %u",(unsigned)measured_hz);
+	Si5351A_xtal_measured(si,measured_hz);
+}
+
+int
+Si5351A_trace_recalibrate(Si5351A *si) {
+
+	trace(si,"recalibrate","");
+	return Si5351A_recalibrate(si);
+}
+
+bool
+Si5351A_trace_set_frequency(Si5351A *si,int clockx,short pllx,uint32_t freq_hz) {
+
+	trace(si,"set_frequency"," %d %d %u",clockx,pllx,(unsigned)freq_hz);
+	return Si5351A_set_frequency(si,clockx,pllx,freq_hz);
+}
+
+bool
+Si5351A_trace_apply_freqs(Si5351A *si,const ClockFreq cf[3],uint32_t *bus_us) {
+
+	trace(si,"apply_freqs"," %u %d %u %d %u %d",
+		(unsigned)cf[0].freq_hz,cf[0].pllx,
+		(unsigned)cf[1].freq_hz,cf[1].pllx,
+		(unsigned)cf[2].freq_hz,cf[2].pllx);
+	return Si5351A_apply_freqs(si,cf,bus_us);
+}
+
+bool
+Si5351A_trace_commit(Si5351A *si,const RegPatch *p,unsigned n) {
+
+	trace_patches(si,p,n);
+	trace(si,"commit"," %u",n);
+	return Si5351A_commit(si,p,n);
+}
+
+bool
+Si5351A_trace_plan_run(Si5351A *si,const Si5351A *tgt,const WritePlan *plan) {
+
+	untraced("plan_run");
+	return Si5351A_plan_run(si,tgt,plan);
+}
+
+bool
+Si5351A_trace_transition(Si5351A *si,const Si5351A *tgt,const BusCost *cost) {
+
+	untraced("transition");
+	return Si5351A_transition(si,tgt,cost);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Timing dependent calls are logged after the fact, and only when
+// they went to the bus: the scheduler as the parameters it wrote,
+// the monitor as the register index it read from.
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_trace_sched_poll(RetuneSched *rs,uint32_t now_us) {
+	int rc = Si5351A_sched_poll(rs,now_us);
+
+	if ( rc != 0 )
+		trace(rs->si,"sched_commit"," %d %u %u %u",rs->pllx,(unsigned)rs->A,(unsigned)rs->B,(unsigned)rs->C);
+	return rc;
+}
+
+int
+Si5351A_trace_monitor_poll(Monitor *mon,uint32_t now_us,uint8_t *diffs,unsigned maxdiffs) {
+	unsigned regx = mon->regx;
+	uint32_t busy_us = mon->busy_us;
+	int rc = Si5351A_monitor_poll(mon,now_us,diffs,maxdiffs);
+
+	if ( rc < 0 || mon->busy_us != busy_us )
+		trace(mon->si,"monitor_read"," %u",regx);
+	return rc;
+}
+
+//////////////////////////////////////////////////////////////////////
+// A sweep is logged once it returns, with the number of points done
+// (the callback may stop it early).
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_trace_sweep(Si5351A *si,const Sweep *sw) {
+	int rc = Si5351A_sweep(si,sw);
+
+	trace(si,"sweep"," %u %u %u %d %d %d %d",(unsigned)sw->start_hz,(unsigned)sw->stop_hz,
+		sw->points,sw->log,sw->clockx,sw->pllx,rc);
+	return rc;
+}
+
+int
+Si5351A_trace_verify(Si5351A *si,uint8_t *diffs,unsigned maxdiffs) {
+
+	trace(si,"verify","");
+	return Si5351A_verify(si,diffs,maxdiffs);
+}
+
+void
+Si5351A_trace_intidx_use(Si5351A *si,const IntIndex *idx) {
+
+	trace(si,"intidx_use"," %u",idx ? (unsigned)idx->xtal_hz : 0u);
+	Si5351A_intidx_use(si,idx);
+}
+
+int
+Si5351A_trace_shm_publish(DevShm *shm,Si5351A *si,bool poll_status) {
+
+	trace(si,"shm_publish"," %d",poll_status);
+	return Si5351A_shm_publish(shm,si,poll_status);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Hoppers are identified by device and output.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_trace_hop_init(Hopper *hp,Si5351A *si,int clockx,uint32_t freq_hz) {
+
+	trace(si,"hop_init"," %d %u",clockx,(unsigned)freq_hz);
+	return Si5351A_hop_init(hp,si,clockx,freq_hz);
+}
+
+bool
+Si5351A_trace_hop_next(Hopper *hp,uint32_t freq_hz) {
+
+	trace(hp->si,"hop_next"," %d %u",hp->clockx,(unsigned)freq_hz);
+	return Si5351A_hop_next(hp,freq_hz);
+}
+
+int
+Si5351A_trace_hop_poll(Hopper *hp) {
+
+	trace(hp->si,"hop_poll"," %d",hp->clockx);
+	return Si5351A_hop_poll(hp);
+}
+
+bool
+Si5351A_trace_hop_switch(Hopper *hp) {
+
+	trace(hp->si,"hop_switch"," %d",hp->clockx);
+	return Si5351A_hop_switch(hp);
+}
+
+bool
+Si5351A_trace_hop(Hopper *hp,uint32_t freq_hz) {
+
+	trace(hp->si,"hop"," %d %u",hp->clockx,(unsigned)freq_hz);
+	return Si5351A_hop(hp,freq_hz);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Async operations are logged when started; their bursts are the
+// same as those of the synchronous calls, which replay them.
+//////////////////////////////////////////////////////////////////////
+
+bool
+Si5351A_trace_commit_async(Si5351A *si,AsyncOp *op,const RegPatch *p,unsigned n,async_donecb_t *done,void *ctx) {
+
+	if ( si->i2c_submit && n <= SI5351A_ASYNC_PATCHES ) {
+		trace_patches(si,p,n);
+		trace(si,"commit_async"," %u",n);
+	}
+	return Si5351A_commit_async(si,op,p,n,done,ctx);
+}
+
+bool
+Si5351A_trace_set_frequency_async(Si5351A *si,AsyncOp *op,int clockx,short pllx,uint32_t freq_hz,async_donecb_t *done,void *ctx) {
+
+	if ( si->i2c_submit )
+		trace(si,"set_frequency_async"," %d %d %u",clockx,pllx,(unsigned)freq_hz);
+	return Si5351A_set_frequency_async(si,op,clockx,pllx,freq_hz,done,ctx);
+}
+
+//////////////////////////////////////////////////////////////////////
+// The fleet runs its chips from worker threads, so each chip is logged
+// here as one "fleet_chip" call: attach plus device reset on replay.
+//////////////////////////////////////////////////////////////////////
+
+int
+Si5351A_trace_fleet_init(FleetChip *chips,unsigned n,const FleetBus *buses,unsigned nbuses,uint32_t timeout_us) {
+
+	for ( unsigned x=0; x<n; ++x )
+		trace(chips[x].si,"fleet_chip"," %u %d",chips[x].i2c_addr,(int)chips[x].cap);
+	return Si5351A_fleet_init(chips,n,buses,nbuses,timeout_us);
+}
+
+// End si5351a_trace.c
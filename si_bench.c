@@ -0,0 +1,304 @@
+///////////////////////////////////////////////////////////////////////
+// si_bench.c -- Cross-check and benchmark of the P1/P2/P3 encoder
+// Date: Mon Oct 19 17:48:10 2026   (C) ve3wwg@gmail.com
+//
+// Built against si5351a.c compiled with SI5351A_NO_HWDIV (make bench)
+// and compared with the dividing encoder, reproduced below:
+//
+//	1. Every B for C = 1048575 (the fixed PLL denominator)
+//	2. Every B < C for every C up to 2048
+//	3. B = 0, 1, C/2, C-1 for every C up to 1048575
+//	4. Random A, B, C (including B >= C and wrapping 128 * B)
+//
+// then times both encoders.
+//
+// With SI_BENCH_TARGET (make bench-mcu) it builds instead as an object
+// for the target core: link it into a firmware image and call
+// si_bench_target(BenchResult *res,unsigned rounds). Core cycles come
+// from DWT_CYCCNT (Cortex-M3 and up) or SysTick (Cortex-M0/M0+/M23,
+// which have no DWT counter).
+///////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#ifndef SI_BENCH_TARGET
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES()	__rdtsc()	// TSC (reference) cycles
+#endif
+#endif
+
+#include "si5351a.h"
+
+static unsigned long checks = 0, failures = 0;
+
+//////////////////////////////////////////////////////////////////////
+// Reference: the dividing encoder
+//////////////////////////////////////////////////////////////////////
+
+static void
+ref_encode(uint8_t *p,uint32_t A,uint32_t B,uint32_t C) {
+	uint32_t P1, P2, P3;
+
+	P2 = (128u * B) % C;
+	P1 = 128u * A + 128u * B / C - 512;
+	P3 = C;
+
+	p[0] = P3 >> 8;
+	p[1] = P3;
+	p[2] = (P1 >> 16) & 0x03;
+	p[3] = P1 >> 8;
+	p[4] = P1;
+	p[5] = ((P3 >> 12) & 0xF0) | ((P2 >> 16) & 0x0F);
+	p[6] = P2 >> 8;
+	p[7] = P2;
+}
+
+static void
+check(uint32_t A,uint32_t B,uint32_t C) {
+	uint8_t ref[8];
+	RegPatch p;
+
+	ref_encode(ref,A,B,C);
+	Si5351A_encode_msynth(0,A,B,C,&p);
+	++checks;
+	if ( memcmp(ref,p.data,sizeof ref) ) {
+#ifndef SI_BENCH_TARGET
+		if ( ++failures <= 10 )
+			fprintf(stderr,"Mismatch: A=%u B=%u C=%u\n",(unsigned)A,(unsigned)B,(unsigned)C);
+#else
+		++failures;
+#endif
+	}
+}
+
+#ifdef SI_BENCH_TARGET
+
+//////////////////////////////////////////////////////////////////////
+// Target core cycle counter
+//////////////////////////////////////////////////////////////////////
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+
+#define DEMCR		(*(volatile uint32_t *)0xE000EDFC)
+#define DWT_CTRL	(*(volatile uint32_t *)0xE0001000)
+#define DWT_CYCCNT	(*(volatile uint32_t *)0xE0001004)
+#define CYCLE_MASK	0xFFFFFFFFu
+
+static void
+cycles_init(void) {
+
+	DEMCR |= 1u << 24;		// TRCENA
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= 1;			// CYCCNTENA
+}
+
+static uint32_t
+cycles(void) {
+
+	return DWT_CYCCNT;
+}
+
+#elif defined(__ARM_ARCH_6M__) || defined(__ARM_ARCH_8M_BASE__)
+
+#define SYST_CSR	(*(volatile uint32_t *)0xE000E010)
+#define SYST_RVR	(*(volatile uint32_t *)0xE000E014)
+#define SYST_CVR	(*(volatile uint32_t *)0xE000E018)
+#define CYCLE_MASK	0x00FFFFFFu	// 24 bit down counter
+
+static void
+cycles_init(void) {
+
+	SYST_RVR = CYCLE_MASK;
+	SYST_CVR = 0;
+	SYST_CSR = 0b101;		// Core clock, no interrupt, enabled
+}
+
+static uint32_t
+cycles(void) {
+
+	return CYCLE_MASK - SYST_CVR;
+}
+
+#else
+#error "SI_BENCH_TARGET: no cycle counter known for this core"
+#endif
+
+#define BENCH_BATCH	64		// Encodes per reading (< 2^24 cycles)
+#define BENCH_SETS	256
+
+typedef struct {			// si_bench_target() results
+	uint32_t	checks;		// Encodes cross-checked
+	uint32_t	failures;	// Mismatches with the dividing encoder
+	uint32_t	encodes;	// Encodes timed per encoder
+	uint32_t	ref_cycles;	// Core cycles, dividing encoder
+	uint32_t	lib_cycles;	// Core cycles, library encoder
+} BenchResult;
+
+//////////////////////////////////////////////////////////////////////
+// Core cycles for rounds * BENCH_SETS encodes, read per batch so that
+// a 24 bit counter does not wrap between readings.
+//////////////////////////////////////////////////////////////////////
+
+static uint32_t
+bench_cycles(bool ref,const uint32_t (*abc)[3],unsigned rounds) {
+	volatile uint8_t sink = 0;
+	uint32_t total = 0;
+	RegPatch p;
+
+	for ( unsigned round=0; round<rounds; ++round ) {
+		for ( unsigned x=0; x<BENCH_SETS; x += BENCH_BATCH ) {
+			uint32_t c0 = cycles();
+
+			for ( unsigned y=x; y < x + BENCH_BATCH; ++y ) {
+				if ( ref ) {
+					memset(&p,0,sizeof p);
+					ref_encode(p.data,abc[y][0],abc[y][1],abc[y][2]);
+				} else	Si5351A_encode_msynth(0,abc[y][0],abc[y][1],abc[y][2],&p);
+				sink ^= p.data[7];
+			}
+			total += (cycles() - c0) & CYCLE_MASK;
+		}
+	}
+	(void)sink;
+	return total;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Cross-check every B for the fixed PLL denominator and every B < C
+// for C up to 256, then time both encoders on the target core.
+//////////////////////////////////////////////////////////////////////
+
+void
+si_bench_target(BenchResult *res,unsigned rounds) {
+	static uint32_t abc[BENCH_SETS][3];
+	uint32_t seed = 5351;
+
+	checks = failures = 0;
+	for ( uint32_t B=0; B<1048575; ++B )
+		check(36,B,1048575);
+	for ( uint32_t C=1; C<=256; ++C )
+		for ( uint32_t B=0; B<C; ++B )
+			check(90,B,C);
+
+	for ( unsigned x=0; x<BENCH_SETS; ++x ) {
+		seed = seed * 1103515245u + 12345u;
+		abc[x][0] = 15 + (seed >> 16) % 76;
+		seed = seed * 1103515245u + 12345u;
+		abc[x][2] = x & 1 ? 1048575 : 1 + (seed >> 8) % 1048575;
+		seed = seed * 1103515245u + 12345u;
+		abc[x][1] = (seed >> 8) % abc[x][2];
+	}
+
+	cycles_init();
+	res->checks = checks;
+	res->failures = failures;
+	res->encodes = rounds * BENCH_SETS;
+	res->ref_cycles = bench_cycles(true,(const uint32_t (*)[3])abc,rounds);
+	res->lib_cycles = bench_cycles(false,(const uint32_t (*)[3])abc,rounds);
+}
+
+#else // Host
+
+static double
+now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Time n encodes of the parameter sets in abc[] (ns per encode, and
+// cycles per encode where a cycle counter is available)
+//////////////////////////////////////////////////////////////////////
+
+static double
+bench(bool ref,const uint32_t (*abc)[3],unsigned nabc,unsigned n,double *cycles) {
+	volatile uint8_t sink = 0;
+	RegPatch p;
+	double t0, t1;
+#ifdef CYCLES
+	uint64_t c0 = CYCLES();
+#endif
+
+	t0 = now_ns();
+	for ( unsigned x=0; x<n; ++x ) {
+		const uint32_t *v = abc[x % nabc];
+
+		if ( ref ) {
+			memset(&p,0,sizeof p);
+			ref_encode(p.data,v[0],v[1],v[2]);
+		} else	Si5351A_encode_msynth(0,v[0],v[1],v[2],&p);
+		sink ^= p.data[7];
+	}
+	t1 = now_ns();
+#ifdef CYCLES
+	*cycles = (double)(CYCLES() - c0) / n;
+#else
+	*cycles = 0;
+#endif
+	(void)sink;
+	return (t1 - t0) / n;
+}
+
+int
+main(int argc,char **argv) {
+	static uint32_t abc[4096][3];
+	unsigned n = 10000000;
+	double ns, cycles;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"n:h")) != -1 ) {
+		switch ( optch ) {
+		case 'n':
+			n = strtoul(optarg,0,10);
+			break;
+		default:
+			printf("Usage: %s [-n encodes]\n",argv[0]);
+			return optch == 'h' ? 0 : 1;
+		}
+	}
+
+	for ( uint32_t B=0; B<1048575; ++B )
+		check(36,B,1048575);
+	for ( uint32_t C=1; C<=2048; ++C )
+		for ( uint32_t B=0; B<C; ++B )
+			check(90,B,C);
+	for ( uint32_t C=1; C<=1048575; ++C ) {
+		check(15,0,C);
+		check(15,1 % C,C);
+		check(15,C/2,C);
+		check(15,C-1,C);
+	}
+	srand(5351);
+	for ( unsigned x=0; x<4000000; ++x ) {
+		uint32_t C = ((uint32_t)rand() << 8 ^ rand()) | 1;
+		uint32_t B = (uint32_t)rand() << 8 ^ rand();
+
+		if ( x & 1 )
+			C &= 0xFFFFF;		// Register width
+		check(rand() % 2049,B,C ? C : 1);
+	}
+	printf("%lu checks, %lu failures\n",checks,failures);
+
+	for ( unsigned x=0; x<4096; ++x ) {
+		abc[x][0] = 15 + rand() % 76;
+		abc[x][2] = x & 1 ? 1048575 : 1 + rand() % 1048575;
+		abc[x][1] = rand() % abc[x][2];
+	}
+	ns = bench(true,(const uint32_t (*)[3])abc,4096,n,&cycles);
+	printf("dividing encoder:     %6.2f ns %6.1f cycles\n",ns,cycles);
+	ns = bench(false,(const uint32_t (*)[3])abc,4096,n,&cycles);
+	printf("shift-subtract (lib): %6.2f ns %6.1f cycles\n",ns,cycles);
+	return failures ? 2 : 0;
+}
+
+#endif // SI_BENCH_TARGET
+
+// End si_bench.c
@@ -0,0 +1,538 @@
+///////////////////////////////////////////////////////////////////////
+// si_replay.c -- Replay Si5351A call traces for bus cost comparison
+// Date: Mon Oct 19 19:41:27 2026   (C) ve3wwg@gmail.com
+//
+// Runs a trace recorded with -DSI5351A_TRACE (si5351a_trace.c) against
+// an in-memory Si5351A and reports I2C transactions, bytes, wire time
+// and the final register image of each device:
+//
+//	si_replay [-b bus_hz] [-t txn_us] [-o result] trace.log
+//	si_replay -c old.result new.result
+//
+// Build si_replay from each library version, replay the same trace
+// with both, then compare the two results. The comparison exits with
+// status 1 if the new build costs more bus time, transactions or bytes,
+// or leaves the device in a different state. A trace holding "!" lines
+// (too many devices, or calls that could not be recorded) is refused.
+//
+// Async operations are replayed by their synchronous counterparts,
+// which send the same bursts.
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "si5351a.h"
+
+#define MAX_DEVS	128		// Must match si5351a_trace.c TRACE_DEVS
+#define MAX_ARGS	(2+2*SI5351A_PATCH_MAX)	// patch reg len data... mask...
+#define MAX_PATCHES	16
+
+typedef struct {			// In-memory Si5351A
+	uint8_t		regs[256];
+	uint8_t		regx;		// Register pointer
+	bool		used;
+	Si5351A		si;
+	RegPatch	patches[MAX_PATCHES];	// Logged ahead of a commit
+	unsigned	npatches;
+	Hopper		hop[3];		// By output
+} Model;
+
+typedef struct {			// Replay result
+	unsigned long	calls;
+	unsigned long	txns;
+	unsigned long	bytes;
+	unsigned long	wire_us;
+	bool		dev[MAX_DEVS];
+	uint8_t		image[MAX_DEVS][256];
+} Result;
+
+static Model models[MAX_DEVS];
+static Model *model = 0;		// Device of the call being replayed
+static unsigned long txns = 0, bytes = 0;
+static IntIndex intidx;			// Rebuilt for "intidx_use"
+static bool intidx_built = false;
+
+static int
+writecb(uint8_t i2c_addr,uint8_t *buf,uint8_t n) {
+
+	++txns;
+	bytes += n;
+	if ( n < 1 )
+		return -1;
+	model->regx = buf[0];
+	for ( unsigned x=1; x<n; ++x ) {
+		uint8_t v = buf[x];
+
+		if ( model->regx == 177 )
+			v &= ~0xA0;		// PLL resets complete at once
+		if ( model->regx != 0 )		// Status is read only
+			model->regs[model->regx] = v;
+		++model->regx;
+	}
+	return n;
+}
+
+static int
+readcb(uint8_t i2c_addr,uint8_t *buf,uint8_t n) {
+
+	++txns;
+	bytes += n;
+	for ( unsigned x=0; x<n; ++x )
+		buf[x] = model->regs[model->regx++];
+	return n;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Replay one call. Returns false for an unknown call or bad arguments.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+sweep_stop(void *arg,unsigned pointx,uint32_t freq_hz) {
+
+	return pointx + 1 < *(unsigned *)arg;
+}
+
+static bool
+replay(Model *m,const char *call,const long *v,int nv) {
+	Si5351A *si = &m->si;
+	ClockFreq cf[3];
+	RegPatch *p;
+	RetuneSched rs;
+	Monitor mon;
+	Sweep sw;
+	uint8_t diffs[1];
+	unsigned done;
+
+#define NARGS(n)	if ( nv != n ) return false
+	if ( !strcmp(call,"init") ) {
+		NARGS(2);
+		m->used = true;
+		Si5351A_init(si,v[0],readcb,writecb,0,(XtalCap)v[1]);
+	} else if ( !strcmp(call,"attach") ) {
+		NARGS(1);
+		m->used = true;
+		Si5351A_attach(si,v[0],readcb,writecb,0);
+	} else if ( !strcmp(call,"fleet_chip") ) {
+		NARGS(2);			// Si5351A_fleet_init() of one chip
+		m->used = true;
+		Si5351A_attach(si,v[0],readcb,writecb,0);
+		Si5351A_device_reset(si,(XtalCap)v[1]);
+	} else	{
+		if ( !m->used )
+			return false;		// No init for this device
+		if ( !strcmp(call,"device_reset") ) {
+			NARGS(1);
+			Si5351A_device_reset(si,(XtalCap)v[0]);
+		} else if ( !strcmp(call,"reset_begin") ) {
+			NARGS(1);
+			Si5351A_reset_begin(si,(XtalCap)v[0]);
+		} else if ( !strcmp(call,"reset_step") ) {
+			NARGS(0);
+			Si5351A_reset_step(si);
+		} else if ( !strcmp(call,"is_busy") ) {
+			NARGS(0);
+			Si5351A_is_busy(si);
+		} else if ( !strcmp(call,"clock_enable") ) {
+			NARGS(2);
+			Si5351A_clock_enable(si,v[0],v[1]);
+		} else if ( !strcmp(call,"clock_enable_pin") ) {
+			NARGS(2);
+			Si5351A_clock_enable_pin(si,v[0],v[1]);
+		} else if ( !strcmp(call,"clock_power") ) {
+			NARGS(2);
+			Si5351A_clock_power(si,v[0],v[1]);
+		} else if ( !strcmp(call,"clock_msynth") ) {
+			NARGS(2);
+			Si5351A_clock_msynth(si,v[0],(MultiSynthMode)v[1]);
+		} else if ( !strcmp(call,"clock_polarity") ) {
+			NARGS(2);
+			Si5351A_clock_polarity(si,v[0],v[1]);
+		} else if ( !strcmp(call,"clock_source") ) {
+			NARGS(2);
+			Si5351A_clock_source(si,v[0],(ClockSource)v[1]);
+		} else if ( !strcmp(call,"clock_pll") ) {
+			NARGS(2);
+			Si5351A_clock_pll(si,v[0],v[1]);
+		} else if ( !strcmp(call,"clock_drive") ) {
+			NARGS(2);
+			Si5351A_clock_drive(si,v[0],(ClockDrive)v[1]);
+		} else if ( !strcmp(call,"clock_disable_state") ) {
+			NARGS(2);
+			Si5351A_clock_disable_state(si,v[0],(DisState)v[1]);
+		} else if ( !strcmp(call,"clock_intmask") ) {
+			NARGS(2);
+			Si5351A_clock_intmask(si,v[0],v[1]);
+		} else if ( !strcmp(call,"xtal_cap") ) {
+			NARGS(1);
+			Si5351A_xtal_cap(si,(XtalCap)v[0]);
+		} else if ( !strcmp(call,"pll_reset") ) {
+			NARGS(1);
+			Si5351A_pll_reset(si,v[0]);
+		} else if ( !strcmp(call,"pll_is_reset") ) {
+			NARGS(1);
+			Si5351A_pll_is_reset(si,v[0]);
+		} else if ( !strcmp(call,"set_pll") ) {
+			NARGS(4);
+			Si5351A_set_pll(si,v[0],v[1],v[2],v[3]);
+		} else if ( !strcmp(call,"set_msynth") ) {
+			NARGS(4);
+			Si5351A_set_msynth(si,v[0],v[1],v[2],v[3]);
+		} else if ( !strcmp(call,"msynth_div") ) {
+			NARGS(2);
+			Si5351A_msynth_div(si,v[0],(RxDiv)v[1]);
+#ifndef SI5351A_NO_PHASE
+		} else if ( !strcmp(call,"set_phase") ) {
+			NARGS(2);
+			Si5351A_set_phase(si,v[0],v[1]);
+#endif
+#ifndef SI5351A_NO_SPREAD
+		} else if ( !strcmp(call,"spread") ) {
+			NARGS(2);
+			Si5351A_spread(si,(SpreadMode)v[0],v[1]);
+		} else if ( !strcmp(call,"spread_enable") ) {
+			NARGS(1);
+			Si5351A_spread_enable(si,v[0]);
+#endif
+		} else if ( !strcmp(call,"is_lol") ) {
+			NARGS(1);
+			Si5351A_is_lol(si,v[0]);
+		} else if ( !strcmp(call,"xtal_freq") ) {
+			NARGS(1);
+			Si5351A_xtal_freq(si,v[0]);
+		} else if ( !strcmp(call,"xtal_ppb") ) {
+			NARGS(1);
+			Si5351A_xtal_ppb(si,v[0]);
+		} else if ( !strcmp(call,"xtal_measured") ) {
+			NARGS(1);
+			Si5351A_xtal_measured(si,v[0]);
+		} else if ( !strcmp(call,"recalibrate") ) {
+			NARGS(0);
+			Si5351A_recalibrate(si);
+		} else if ( !strcmp(call,"set_frequency") ) {
+			NARGS(3);
+			Si5351A_set_frequency(si,v[0],v[1],v[2]);
+		} else if ( !strcmp(call,"apply_freqs") ) {
+			NARGS(6);
+			for ( int x=0; x<3; ++x ) {
+				cf[x].freq_hz = v[x*2];
+				cf[x].pllx = v[x*2+1];
+			}
+			Si5351A_apply_freqs(si,cf,0);
+		} else if ( !strcmp(call,"patch") ) {
+			if ( nv < 2 || v[1] < 1 || v[1] > SI5351A_PATCH_MAX || m->npatches >= MAX_PATCHES )
+				return false;
+			NARGS(2 + 2 * v[1]);
+			p = &m->patches[m->npatches++];
+			p->reg = v[0];
+			p->len = v[1];
+			for ( int x=0; x < p->len; ++x ) {
+				p->data[x] = v[2+x];
+				p->mask[x] = v[2+p->len+x];
+			}
+		} else if ( !strcmp(call,"commit") || !strcmp(call,"commit_async") ) {
+			NARGS(1);
+			if ( v[0] != (long)m->npatches )
+				return false;
+			m->npatches = 0;
+			Si5351A_commit(si,m->patches,v[0]);
+		} else if ( !strcmp(call,"set_frequency_async") ) {
+			NARGS(3);
+			Si5351A_set_frequency(si,v[0],v[1],v[2]);
+		} else if ( !strcmp(call,"sched_commit") ) {
+			NARGS(4);
+			Si5351A_sched_init(&rs,si,v[0]);
+			Si5351A_sched_submit(&rs,v[1],v[2],v[3]);
+			Si5351A_sched_poll(&rs,0);		// First commit: not rate limited
+		} else if ( !strcmp(call,"monitor_read") ) {
+			NARGS(1);
+			Si5351A_monitor_init(&mon,si,1000,0);	// Full bus share: always reads
+			mon.regx = v[0];
+			Si5351A_monitor_poll(&mon,1000000,diffs,0);
+		} else if ( !strcmp(call,"sweep") ) {
+			NARGS(7);
+			memset(&sw,0,sizeof sw);
+			sw.start_hz = v[0];
+			sw.stop_hz = v[1];
+			sw.points = v[2];
+			sw.log = v[3];
+			sw.clockx = v[4];
+			sw.pllx = v[5];
+			if ( v[6] > 0 && v[6] < v[2] ) {
+				done = v[6];		// Stopped early by the callback
+				sw.cb = sweep_stop;
+				sw.arg = &done;
+			}
+			Si5351A_sweep(si,&sw);
+		} else if ( !strcmp(call,"verify") ) {
+			NARGS(0);
+			Si5351A_verify(si,diffs,0);
+		} else if ( !strcmp(call,"intidx_use") ) {
+			NARGS(1);
+			if ( !v[0] )
+				Si5351A_intidx_use(si,0);
+			else	{
+				if ( !intidx_built || intidx.xtal_hz != (uint32_t)v[0] ) {
+					if ( intidx_built )
+						Si5351A_intidx_free(&intidx);
+					if ( Si5351A_intidx_build(&intidx,v[0]) < 0 )
+						return false;
+					intidx_built = true;
+				}
+				Si5351A_intidx_use(si,&intidx);
+			}
+		} else if ( !strcmp(call,"shm_publish") ) {
+			NARGS(1);
+			if ( v[0] )
+				Si5351A_is_lol(si,0);		// Status poll: one read of r0
+		} else if ( !strncmp(call,"hop",3) ) {
+			if ( nv < 1 || v[0] < 0 || v[0] > 2 )
+				return false;
+			if ( !strcmp(call,"hop_init") ) {
+				NARGS(2);
+				Si5351A_hop_init(&m->hop[v[0]],si,v[0],v[1]);
+			} else if ( m->hop[v[0]].si != si ) {
+				return false;		// No hop_init for this output
+			} else if ( !strcmp(call,"hop_next") ) {
+				NARGS(2);
+				Si5351A_hop_next(&m->hop[v[0]],v[1]);
+			} else if ( !strcmp(call,"hop_poll") ) {
+				NARGS(1);
+				Si5351A_hop_poll(&m->hop[v[0]]);
+			} else if ( !strcmp(call,"hop_switch") ) {
+				NARGS(1);
+				Si5351A_hop_switch(&m->hop[v[0]]);
+			} else if ( !strcmp(call,"hop") ) {
+				NARGS(2);
+				Si5351A_hop(&m->hop[v[0]],v[1]);
+			} else	return false;
+		} else	return false;
+	}
+#undef NARGS
+	return true;
+}
+
+static int
+run_trace(const char *path,const BusCost *cost,Result *res) {
+	char line[256], call[32];
+	long v[MAX_ARGS];
+	unsigned lno = 0, devx;
+	int nv, pos;
+	FILE *f;
+
+	if ( !(f = fopen(path,"r")) ) {
+		perror(path);
+		return -1;
+	}
+	memset(res,0,sizeof *res);
+	while ( fgets(line,sizeof line,f) ) {
+		char *cp, *ep;
+
+		++lno;
+		if ( line[0] == '#' || line[0] == '\n' )
+			continue;
+		if ( line[0] == '!' ) {
+			line[strcspn(line,"\n")] = 0;
+			fprintf(stderr,"%s:%u: trace incomplete (%s)\n",path,lno,line+2);
+			fclose(f);
+			return -1;
+		}
+		if ( sscanf(line,"%u %31s %n",&devx,call,&pos) < 2 || devx >= MAX_DEVS ) {
+			fprintf(stderr,"%s:%u: bad line\n",path,lno);
+			fclose(f);
+			return -1;
+		}
+		for ( nv=0, cp=line+pos; nv < MAX_ARGS; ++nv, cp=ep ) {
+			v[nv] = strtol(cp,&ep,10);
+			if ( ep == cp )
+				break;
+		}
+		model = &models[devx];
+		if ( !replay(model,call,v,nv) ) {
+			fprintf(stderr,"%s:%u: cannot replay '%s'\n",path,lno,call);
+			fclose(f);
+			return -1;
+		}
+		++res->calls;
+	}
+	fclose(f);
+
+	res->txns = txns;
+	res->bytes = bytes;
+	res->wire_us = Si5351A_bus_time_us(cost,txns,bytes);
+	for ( devx=0; devx < MAX_DEVS; ++devx ) {
+		res->dev[devx] = models[devx].used;
+		memcpy(res->image[devx],models[devx].regs,256);
+	}
+	return 0;
+}
+
+static int
+save_result(const char *path,const Result *res) {
+	FILE *f = path ? fopen(path,"w") : stdout;
+
+	if ( !f ) {
+		perror(path);
+		return -1;
+	}
+	fprintf(f,"calls %lu\ntxns %lu\nbytes %lu\nwire_us %lu\n",res->calls,res->txns,res->bytes,res->wire_us);
+	for ( unsigned devx=0; devx < MAX_DEVS; ++devx ) {
+		if ( !res->dev[devx] )
+			continue;
+		fprintf(f,"image %u ",devx);
+		for ( unsigned x=0; x<256; ++x )
+			fprintf(f,"%02X",res->image[devx][x]);
+		fputc('\n',f);
+	}
+	if ( path )
+		fclose(f);
+	return 0;
+}
+
+static int
+load_result(const char *path,Result *res) {
+	char key[16], hex[520];
+	unsigned long val;
+	unsigned devx, byte;
+	FILE *f;
+
+	if ( !(f = fopen(path,"r")) ) {
+		perror(path);
+		return -1;
+	}
+	memset(res,0,sizeof *res);
+	while ( fscanf(f,"%15s",key) == 1 ) {
+		if ( !strcmp(key,"image") ) {
+			if ( fscanf(f,"%u %519s",&devx,hex) != 2 || devx >= MAX_DEVS || strlen(hex) != 512 )
+				break;
+			res->dev[devx] = true;
+			for ( unsigned x=0; x<256; ++x ) {
+				sscanf(hex+x*2,"%2x",&byte);
+				res->image[devx][x] = byte;
+			}
+			continue;
+		}
+		if ( fscanf(f,"%lu",&val) != 1 )
+			break;
+		if ( !strcmp(key,"calls") )
+			res->calls = val;
+		else if ( !strcmp(key,"txns") )
+			res->txns = val;
+		else if ( !strcmp(key,"bytes") )
+			res->bytes = val;
+		else if ( !strcmp(key,"wire_us") )
+			res->wire_us = val;
+	}
+	fclose(f);
+	return 0;
+}
+
+static bool
+compare_metric(const char *name,unsigned long old,unsigned long new) {
+
+	printf("%-8s %10lu %10lu %+10ld",name,old,new,(long)new - (long)old);
+	if ( old )
+		printf(" %+7.1f%%",((double)new - old) * 100.0 / old);
+	putchar('\n');
+	return new <= old;
+}
+
+static int
+compare(const char *oldpath,const char *newpath) {
+	static Result old, new;
+	bool ok = true;
+
+	if ( load_result(oldpath,&old) || load_result(newpath,&new) )
+		return 2;
+	if ( old.calls != new.calls )
+		printf("Warning: %lu vs %lu calls replayed (different traces?)\n",old.calls,new.calls);
+
+	printf("%-8s %10s %10s %10s\n","","old","new","delta");
+	ok = compare_metric("txns",old.txns,new.txns) && ok;
+	ok = compare_metric("bytes",old.bytes,new.bytes) && ok;
+	ok = compare_metric("wire_us",old.wire_us,new.wire_us) && ok;
+
+	for ( unsigned devx=0; devx < MAX_DEVS; ++devx ) {
+		if ( old.dev[devx] != new.dev[devx] ) {
+			printf("Device %u: present in one result only\n",devx);
+			ok = false;
+			continue;
+		}
+		for ( unsigned x=0; old.dev[devx] && x<256; ++x ) {
+			if ( old.image[devx][x] != new.image[devx][x] ) {
+				printf("Device %u: r%u %02X -> %02X\n",devx,x,old.image[devx][x],new.image[devx][x]);
+				ok = false;
+			}
+		}
+	}
+	printf("%s\n",ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
+
+static void
+usage(const char *cmd) {
+
+	printf("Usage: %s [-b bus_hz] [-t txn_us] [-o result] trace.log\n"
+		"       %s -c old.result new.result\n"
+		"where:\n"
+		"\t-b :\tI2C clock rate (default 100000)\n"
+		"\t-t :\tHost overhead per transaction, us (default 0)\n"
+		"\t-o :\tWrite result to file (default stdout)\n"
+		"\t-c\tCompare two results\n"
+		"\t-h\tThis help.\n",cmd,cmd);
+}
+
+int
+main(int argc,char **argv) {
+	const char *outpath = 0;
+	uint32_t bus_hz = 100000, txn_us = 0;
+	bool comparef = false;
+	BusCost cost;
+	static Result res;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"b:t:o:ch")) != -1 ) {
+		switch ( optch ) {
+		case 'b':
+			bus_hz = strtoul(optarg,0,10);
+			break;
+		case 't':
+			txn_us = strtoul(optarg,0,10);
+			break;
+		case 'o':
+			outpath = optarg;
+			break;
+		case 'c':
+			comparef = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if ( comparef ) {
+		if ( argc - optind != 2 ) {
+			usage(argv[0]);
+			return 2;
+		}
+		return compare(argv[optind],argv[optind+1]);
+	}
+
+	if ( argc - optind != 1 || !bus_hz ) {
+		usage(argv[0]);
+		return 2;
+	}
+	Si5351A_bus_cost(&cost,bus_hz);
+	cost.txn_us = txn_us;
+	if ( run_trace(argv[optind],&cost,&res) )
+		return 2;
+	return save_result(outpath,&res) ? 2 : 0;
+}
+
+// End si_replay.c